@@ -3,15 +3,94 @@
 
 using namespace eosio;
 
-asset medishares::keymarket::convert_to_exchange( connector& c, asset in ) {
-    real_type R(supply.amount);
-    real_type C(c.balance.amount+in.amount);
-    real_type F(c.weight/1000.0);
-    real_type T(in.amount);
-    real_type ONE(1.0);
+//Q1.63定点数，用于bancor价格计算，避免在wasm中使用double的std::pow
+#define FIXED_FRAC_BITS 63
+#define FIXED_ONE ((uint64_t)1 << FIXED_FRAC_BITS)
+#define FIXED_LN2 ((uint64_t)0x58b90bfbe8e7bcd5)
+
+//连接器权重的百万分比，目前只配置了默认权重0.5
+#define CONNECTOR_WEIGHT_SCALE 1000000
+#define DEFAULT_WEIGHT_PPM 500000
+
+//log2(n/d)，n >= d > 0，返回Q64.64
+static uint128_t fixed_log2(uint64_t n, uint64_t d){
+    eosio_assert(d > 0 && n >= d, "invalid fixed_log2 argument");
+    uint64_t k = 0;
+    while(((uint128_t)d << (k + 1)) <= n){
+        k++;
+    }
+    uint64_t m = (uint64_t)(((uint128_t)n << FIXED_FRAC_BITS) / ((uint128_t)d << k));
+    uint128_t result = (uint128_t)k << 64;
+    for(int i = 63; i >= 0 && m != FIXED_ONE; i--){
+        uint128_t sq = ((uint128_t)m * m) >> FIXED_FRAC_BITS;
+        if(sq >= ((uint128_t)2 << FIXED_FRAC_BITS)){
+            sq >>= 1;
+            result |= (uint128_t)1 << i;
+        }
+        m = (uint64_t)sq;
+    }
+    return result;
+}
+
+//2^y，y为Q64.64，结果为Q64.64，超出范围时返回false
+static bool fixed_exp2(uint128_t y, uint128_t& result){
+    uint64_t i = (uint64_t)(y >> 64);
+    if(i >= 63){
+        return false;
+    }
+    uint64_t x = (uint64_t)(((uint128_t)(uint64_t)y * FIXED_LN2) >> 64);
+    uint64_t sum = FIXED_ONE;
+    uint64_t term = FIXED_ONE;
+    for(uint64_t k = 1; term != 0; k++){
+        term = (uint64_t)(((uint128_t)term * x) >> FIXED_FRAC_BITS) / k;
+        sum += term;
+    }
+    result = (uint128_t)sum << (i + 1);
+    return true;
+}
+
+//(n/d)^(num/den)，结果为Q64.64
+static bool fixed_pow(uint64_t n, uint64_t d, uint64_t num, uint64_t den, uint128_t& result){
+    return fixed_exp2(fixed_log2(n, d) * num / den, result);
+}
+
+//amount * (p - 1)，p为Q64.64且p >= 1，结果超出资产范围时返回false
+static bool fixed_mul_excess(int64_t amount, uint128_t p, int64_t& result){
+    uint128_t excess = p - ((uint128_t)1 << 64);
+    uint128_t product = (uint128_t)amount * (uint64_t)(excess >> 64) + (((uint128_t)amount * (uint64_t)excess) >> 64);
+    if(product > (uint128_t)asset::max_amount){
+        return false;
+    }
+    result = (int64_t)product;
+    return true;
+}
 
-    real_type E = -R * (ONE - std::pow( ONE + T / C, F) );
-    int64_t issued = int64_t(E);
+static uint64_t connector_weight_ppm(double weight){
+    if(weight == .5){
+        return DEFAULT_WEIGHT_PPM;
+    }
+    return (uint64_t)(weight * CONNECTOR_WEIGHT_SCALE + .5);
+}
+
+bool hbtcoop::keymarket::issue_amount( const connector& c, int64_t in, int64_t& issued )const {
+    //E = R * ((1 + T/C)^F - 1)，C = balance + in，F = weight/1000
+    uint64_t C = (uint64_t)c.balance.amount + in;
+    uint128_t p;
+    return C > 0 && fixed_pow(C + in, C, connector_weight_ppm(c.weight), 1000 * CONNECTOR_WEIGHT_SCALE, p) &&
+           fixed_mul_excess(supply.amount, p, issued);
+}
+
+bool hbtcoop::keymarket::redeem_amount( const connector& c, int64_t in, int64_t& out )const {
+    //T = C * ((1 + E/R)^F - 1)，R = supply - in，F = 1000/weight
+    int64_t R = supply.amount - in;
+    uint128_t p;
+    return R > 0 && fixed_pow((uint64_t)R + in, R, 1000 * CONNECTOR_WEIGHT_SCALE, connector_weight_ppm(c.weight), p) &&
+           fixed_mul_excess(c.balance.amount, p, out);
+}
+
+asset hbtcoop::keymarket::convert_to_exchange( connector& c, asset in ) {
+    int64_t issued = 0;
+    eosio_assert( issue_amount(c, in.amount, issued), "conversion out of range" );
 
     supply.amount += issued;
     c.balance.amount += in.amount;
@@ -24,14 +103,8 @@ asset medishares::keymarket::convert_to_exchange( connector& c, asset in ) {
 asset hbtcoop::keymarket::convert_from_exchange( connector& c, asset in ) {
     eosio_assert( in.symbol== supply.symbol, "unexpected asset symbol input" );
 
-    real_type R(supply.amount - in.amount);
-    real_type C(c.balance.amount);
-    real_type F(1000.0/c.weight);
-    real_type E(in.amount);
-    real_type ONE(1.0);
-
-    real_type T = C * (std::pow( ONE + E/R, F) - ONE);
-    int64_t out = int64_t(T);
+    int64_t out = 0;
+    eosio_assert( redeem_amount(c, in.amount, out), "conversion out of range" );
 
     supply.amount -= in.amount;
     c.balance.amount -= out;
@@ -71,6 +144,70 @@ asset hbtcoop::keymarket::convert( asset from, symbol_type to ) {
     return from;
 }
 
+hbtcoop::price_quote hbtcoop::get_quote(const struct keymarket& market, asset quantity){
+    bool buy = quantity.symbol == CORE_SYMBOL;
+    eosio_assert(buy || quantity.symbol == KEY_SYMBOL, "this asset is not supported or the symbol precision mismatch");
+    eosio_assert(quantity.amount > 0, "quantity must be positive");
+
+    //超出兑换范围的数量不断言，报价为0，由调用方决定是否拒绝
+    price_quote q;
+    int64_t out = 0;
+    q.quotable = buy ? market.issue_amount(market.quote, quantity.amount, out)
+                     : market.redeem_amount(market.quote, quantity.amount, out);
+    q.output = asset(q.quotable ? out : 0, buy ? KEY_SYMBOL : CORE_SYMBOL);
+    if(q.output.amount <= 0){
+        q.impact_bp = 10000;
+        return q;
+    }
+
+    //现价 = quote余额 / (supply * F)，F = weight / 1000，与issue_amount/redeem_amount的曲线一致，单位为CORE/KEY
+    double spot = (double)market.quote.balance.amount / ((double)market.supply.amount * market.quote.weight / 1000);
+    double price = buy ? (double)quantity.amount / q.output.amount : (double)q.output.amount / quantity.amount;
+    q.impact_bp = (int64_t)((buy ? price / spot - 1 : 1 - price / spot) * 10000);
+    return q;
+}
+
+void hbtcoop::quote(asset quantity){
+    const auto& market = keymarket.get(KEY_SYMBOL, "key market does not exist");
+    auto q = get_quote(market, quantity);
+    eosio_assert(q.quotable, "conversion out of range");
+    print("quote ", quantity.amount, " -> ", q.output.amount, ", price impact ", q.impact_bp, " bp");
+}
+
+void hbtcoop::setladder(vector<asset> points){
+    require_auth(_self);
+    eosio_assert(points.size() <= LADDER_MAX_POINTS, "too many ladder points");
+
+    for(auto itr = ladder.begin(); itr != ladder.end(); ){
+        itr = ladder.erase(itr);
+    }
+    const auto& market = keymarket.get(KEY_SYMBOL, "key market does not exist");
+    for(size_t i = 0; i < points.size(); i++){
+        auto q = get_quote(market, points[i]);
+        ladder.emplace(_self, [&](auto& l){
+            l.id = i;
+            l.quantity = points[i];
+            l.output = q.output;
+            l.impact_bp = q.impact_bp;
+        });
+    }
+}
+
+void hbtcoop::refresh_ladder(){
+    //未设置报价点时只多一次查找
+    if(ladder.begin() == ladder.end()){
+        return;
+    }
+    const auto& market = keymarket.get(KEY_SYMBOL, "key market does not exist");
+    for(auto itr = ladder.begin(); itr != ladder.end(); itr++){
+        auto q = get_quote(market, itr->quantity);
+        ladder.modify(itr, 0, [&](auto& l){
+            l.output = q.output;
+            l.impact_bp = q.impact_bp;
+        });
+    }
+}
+
 void hbtcoop::init(const uint64_t guarantee_rate, const uint64_t ref_rate, asset max_claim)
 {
     eosio_assert(ref_rate > 0 && guarantee_rate > 0, "must positive rate");
@@ -88,7 +225,7 @@ void hbtcoop::init(const uint64_t guarantee_rate, const uint64_t ref_rate, asset
         k.supply.symbol = KEY_SYMBOL;
         k.base.balance.amount = 1000000;
         k.base.balance.symbol = KEY_SYMBOL;
-        k.quote.balance.amount = 100 * 10000;
+        k.quote.balance.amount = KEY_INIT_RESERVE;
         k.quote.balance.symbol = CORE_SYMBOL;
     });
 
@@ -106,7 +243,223 @@ void hbtcoop::init(const uint64_t guarantee_rate, const uint64_t ref_rate, asset
     }); 
 }
 
-void hbtcoop::handleTransfer(const account_name from, const account_name to, const asset& quantity, string memo)
+uint64_t hbtcoop::get_claim_index(){
+    auto claims_itr = claims.find(0);
+    return claims_itr == claims.end() ? 0 : claims_itr->claim_index;
+}
+
+hbtcoop::pool_totals hbtcoop::get_pool_totals(global_table::const_iterator glb){
+    pool_totals totals;
+    totals.guarantee_pool = glb->guarantee_pool.amount;
+    totals.bonus_pool = glb->bonus_pool.amount;
+    int64_t accounts = glb->guaranteed_accounts;
+    for(const auto& shard : shards){
+        totals.guarantee_pool += shard.guarantee_pool;
+        totals.bonus_pool += shard.bonus_pool;
+        accounts += shard.guaranteed_accounts;
+    }
+    totals.guaranteed_accounts = accounts;
+    return totals;
+}
+
+void hbtcoop::add_to_shard(account_name actor, int64_t guarantee_delta, int64_t bonus_delta, int64_t accounts_delta){
+    //账户名低位多为0，先乘以黄金分割常数再取模
+    uint64_t id = ((actor * 0x9E3779B97F4A7C15) >> 32) % GLOBAL_SHARDS;
+    auto shard_itr = shards.find(id);
+    if(shard_itr == shards.end()){
+        shards.emplace(_self, [&](auto& s){
+            s.id = id;
+            s.guarantee_pool = guarantee_delta;
+            s.bonus_pool = bonus_delta;
+            s.guaranteed_accounts = accounts_delta;
+        });
+    }else{
+        shards.modify(shard_itr, 0, [&](auto& s){
+            s.guarantee_pool += guarantee_delta;
+            s.bonus_pool += bonus_delta;
+            s.guaranteed_accounts += accounts_delta;
+        });
+    }
+}
+
+#ifdef HBTCOOP_METRICS
+void hbtcoop::record_metric(uint64_t op, uint64_t work){
+    time window = now() / METRICS_WINDOW * METRICS_WINDOW;
+    auto itr = metrics.find(op);
+    if(itr == metrics.end()){
+        metrics.emplace(_self, [&](auto& m){
+            m.op = op;
+            m.window_start = window;
+            m.calls = 1;
+            m.work = work;
+            m.max_work = work;
+        });
+        return;
+    }
+    metrics.modify(itr, 0, [&](auto& m){
+        if(m.window_start != window){
+            m.last_calls = m.window_start + METRICS_WINDOW == window ? m.calls : 0;
+            m.last_work = m.window_start + METRICS_WINDOW == window ? m.work : 0;
+            m.window_start = window;
+            m.calls = 0;
+            m.work = 0;
+            m.max_work = 0;
+        }
+        m.calls += 1;
+        m.work += work;
+        if(work > m.max_work){
+            m.max_work = work;
+        }
+    });
+}
+#endif
+
+void hbtcoop::audit(){
+    //资金池之间的守恒关系，任何一条不成立都说明记账有误
+    auto glb = global.begin();
+    eosio_assert(glb != global.end(), "the global table does not exist");
+    const auto& market = keymarket.get(KEY_SYMBOL, "key market does not exist");
+    auto totals = get_pool_totals(glb);
+
+    eosio_assert(totals.guarantee_pool >= 0, "guarantee pool is negative");
+    eosio_assert(totals.bonus_pool >= 0, "bonus pool is negative");
+    //bonus全部进入bancor，卖出KEY的EOS全部从bonus_pool支出
+    eosio_assert(market.quote.balance.amount == KEY_INIT_RESERVE + totals.bonus_pool, "bonus pool does not match the bancor reserve");
+    eosio_assert(market.supply.amount >= KEY_INIT_SUPPLY, "key supply below the initial supply");
+}
+
+void hbtcoop::compact(){
+    auto glb = global.begin();
+    eosio_assert(glb != global.end(), "the global table does not exist");
+    auto totals = get_pool_totals(glb);
+    global.modify(glb, 0, [&](auto& gl){
+        gl.guarantee_pool.amount = totals.guarantee_pool;
+        gl.bonus_pool.amount = totals.bonus_pool;
+        gl.guaranteed_accounts = totals.guaranteed_accounts;
+    });
+    for(auto shard_itr = shards.begin(); shard_itr != shards.end(); ){
+        shard_itr = shards.erase(shard_itr);
+    }
+}
+
+//在栈上的定长缓冲区中拼接memo，不分配堆内存；长度上限同eosio.token的memo
+struct memo_writer
+{
+    char   buf[256];
+    size_t len = 0;
+
+    memo_writer& append(const char* str, size_t n){
+        eosio_assert(len + n <= sizeof(buf), "memo has more than 256 bytes");
+        memcpy(buf + len, str, n);
+        len += n;
+        return *this;
+    }
+    memo_writer& append(const char* str){
+        return append(str, strlen(str));
+    }
+    memo_writer& append_uint(uint64_t value){
+        char tmp[20];
+        size_t pos = sizeof(tmp);
+        do{
+            tmp[--pos] = '0' + value % 10;
+            value /= 10;
+        }while(value);
+        return append(tmp + pos, sizeof(tmp) - pos);
+    }
+    memo_writer& append_int(int64_t value){
+        if(value < 0){
+            append("-", 1);
+            return append_uint((uint64_t)(-(value + 1)) + 1);
+        }
+        return append_uint(value);
+    }
+    string str()const{
+        return string(buf, len);
+    }
+};
+
+//memo格式: "key":"value","key":"value"...，目前支持的key:
+//  buyfor  受益账户，默认为转账账户
+//  ref     推荐人账户
+//  batch   批量充值，记入额度后由batchdeposit分配，可以不带value
+//其他文本和不认识的key会被忽略
+struct memo_args
+{
+    account_name buyfor = 0;
+    account_name ref = 0;
+    bool batch = false;
+};
+
+static bool memo_token_equals(const char* token, size_t len, const char* key, size_t key_len){
+    return len == key_len && memcmp(token, key, len) == 0;
+}
+
+//直接把账户名解码为uint64_t，规则同string_to_name，但拒绝非法字符
+static account_name memo_name(const char* str, size_t len){
+    eosio_assert(len > 0 && len <= 12, "invalid account name");
+    uint64_t value = 0;
+    for(size_t i = 0; i < len; i++){
+        char ch = str[i];
+        uint64_t c = 0;
+        if(ch >= 'a' && ch <= 'z'){
+            c = ch - 'a' + 6;
+        }else if(ch >= '1' && ch <= '5'){
+            c = ch - '1' + 1;
+        }else{
+            eosio_assert(ch == '.', "invalid account name");
+        }
+        value |= c << (64 - 5 * (i + 1));
+    }
+    return value;
+}
+
+//单次扫描，不分配内存
+static memo_args parse_memo(const string& memo){
+    memo_args args;
+    const char* p = memo.data();
+    const char* end = p + memo.size();
+    while(p < end){
+        if(*p != '"'){
+            p++;
+            continue;
+        }
+        const char* key = ++p;
+        while(p < end && *p != '"'){
+            p++;
+        }
+        if(p == end){
+            break;
+        }
+        size_t key_len = p - key;
+        p++;
+
+        const char* value = nullptr;
+        size_t value_len = 0;
+        if(end - p >= 2 && p[0] == ':' && p[1] == '"'){
+            value = p + 2;
+            p = value;
+            while(p < end && *p != '"'){
+                p++;
+            }
+            eosio_assert(p < end, "parse memo error");
+            value_len = p - value;
+            p++;
+        }
+
+        if(memo_token_equals(key, key_len, "batch", 5)){
+            args.batch = true;
+        }else if(value == nullptr){
+            continue;
+        }else if(memo_token_equals(key, key_len, "buyfor", 6)){
+            args.buyfor = memo_name(value, value_len);
+        }else if(memo_token_equals(key, key_len, "ref", 3)){
+            args.ref = memo_name(value, value_len);
+        }
+    }
+    return args;
+}
+
+void hbtcoop::handleTransfer(const account_name from, const account_name to, const asset& quantity, const string& memo)
 {
     if(from == _self || to != _self){
         return;
@@ -116,35 +469,33 @@ void hbtcoop::handleTransfer(const account_name from, const account_name to, con
 
     require_auth(from);
 
+    auto args = parse_memo(memo);
+
+    //记入额度，由batchdeposit分配
+    if (args.batch) {
+        auto credit_itr = credits.find(from);
+        if(credit_itr == credits.end()){
+            credits.emplace(_self, [&](auto& c){
+                c.owner = from;
+                c.balance = quantity;
+            });
+        }else{
+            credits.modify(credit_itr, 0, [&](auto& c){
+                c.balance += quantity;
+            });
+        }
+        return;
+    }
+
     account_name participator = from;
-    account_name referrer = 0;
+    account_name referrer = args.ref;
     uint64_t ref_amount = 0;
 
-    memo.erase(memo.begin(), find_if(memo.begin(), memo.end(), [](int ch) {
-        return !isspace(ch);
-    }));
-    memo.erase(find_if(memo.rbegin(), memo.rend(), [](int ch) {
-        return !isspace(ch);
-    }).base(), memo.end());
-
-    //memo:"buyfor":"xxxxxxxxxxxx","ref":"xxxxxxxxxxxx"
-    auto separator_pos = memo.find("\"buyfor\":\"");
-    if (separator_pos != string::npos) {
-        auto end_pos =  memo.find("\"", separator_pos+10); //测试memo="buyfor":"，也就是加10后越界
-        eosio_assert(end_pos != string::npos, "parse memo error");
-        eosio_assert(end_pos - separator_pos <= 22 && end_pos - separator_pos > 10, "invalid account name"); //测试账户名长度为1和12
-        string beneficiary_account_str = memo.substr(separator_pos + 10, end_pos - 1);
-        participator = string_to_name(beneficiary_account_str.c_str()); 
+    if (args.buyfor != 0) {
+        participator = args.buyfor;
         eosio_assert(is_account(participator), "participator account does not exist");
     }
-
-    separator_pos = memo.find("\"ref\":\"");
-    if (separator_pos != string::npos) {
-        auto end_pos =  memo.find("\"", separator_pos+7); //测试memo="ref":"，也就是加7后越界
-        eosio_assert(end_pos != string::npos, "parse memo error");
-        eosio_assert(end_pos - separator_pos <= 19 && end_pos - separator_pos > 7, "invalid account name"); //测试账户名长度为1和12
-        string referral_account_str = memo.substr(separator_pos + 7, end_pos - 1);
-        referrer = string_to_name(referral_account_str.c_str());
+    if (referrer != 0) {
         eosio_assert(is_account(referrer), "referrer account does not exist");
     }
 
@@ -167,25 +518,102 @@ void hbtcoop::handleTransfer(const account_name from, const account_name to, con
     uint64_t bonus_amount = pool_amount - guarantee_amount;
     eosio_assert(bonus_amount > 0, "bonus amount abnormity");
 
-    global.modify(glb, 0, [&](auto& gl){
-        gl.guarantee_pool = gl.guarantee_pool + asset(guarantee_amount, CORE_SYMBOL);
-        gl.bonus_pool = gl.bonus_pool + asset(bonus_amount, CORE_SYMBOL);
+    auto key_out = asset(0, KEY_SYMBOL);
+    const auto& market = keymarket.get(KEY_SYMBOL, "key market does not exist");
+    keymarket.modify( market, 0, [&]( auto& km ) {
+        key_out = km.convert( asset(bonus_amount, CORE_SYMBOL), KEY_SYMBOL);
     });
+    refresh_ladder();
+    eosio_assert( key_out.amount > 0, "must reserve a positive amount" );
 
-    if(!has_balance(participator, asset(guarantee_amount, CORE_SYMBOL))){
-        global.modify(glb, 0, [&](auto& gl){
-            gl.guaranteed_accounts += 1;
-        });
+    //账户和global各只读写一次
+    int64_t guaranteed_delta = deposit_balance(participator, guarantee_amount, key_out.amount, get_claim_index());
+    add_to_shard(from, guarantee_amount, bonus_amount, guaranteed_delta);
+    RECORD_METRIC(deposit, 1);
+}
+
+void hbtcoop::batchdeposit(account_name from, vector<deposit_entry> deposits){
+    require_auth(from);
+    eosio_assert(deposits.size() > 0, "empty deposit list");
+
+    auto credit_itr = credits.find(from);
+    eosio_assert(credit_itr != credits.end(), "no batch transfer found");
+    auto glb = global.begin();
+    eosio_assert(glb != global.end(), "the global table does not exist");
+
+    vector<account_name> beneficiaries;
+    beneficiaries.reserve(deposits.size());
+    for(const auto& d : deposits){
+        beneficiaries.push_back(d.beneficiary);
+    }
+    std::sort(beneficiaries.begin(), beneficiaries.end());
+    eosio_assert(std::adjacent_find(beneficiaries.begin(), beneficiaries.end()) == beneficiaries.end(), "duplicate beneficiary in deposit list");
+
+    //逐笔与剩余额度比较，累加值不会超过credit，也就不会溢出
+    int64_t total_amount = 0;
+    int64_t total_guarantee = 0;
+    vector<int64_t> guarantee_amounts;
+    guarantee_amounts.reserve(deposits.size());
+    for(const auto& d : deposits){
+        eosio_assert(d.quantity.symbol == CORE_SYMBOL, "unsupported symbol");
+        eosio_assert(d.quantity.amount >= 1000, "must greater than 0.1 EOS");
+        eosio_assert(d.quantity.amount <= credit_itr->balance.amount - total_amount, "deposits exceed the transferred amount");
+        eosio_assert(is_account(d.beneficiary), "beneficiary account does not exist");
+        auto guarantee_amount = (int64_t)((double)glb->guarantee_rate /(double)(1000 - glb->ref_rate) * d.quantity.amount);
+        eosio_assert(guarantee_amount >= 0 && d.quantity.amount - guarantee_amount > 0, "bonus amount abnormity");
+        guarantee_amounts.push_back(guarantee_amount);
+        total_amount += d.quantity.amount;
+        total_guarantee += guarantee_amount;
     }
-    add_balance(participator, asset(guarantee_amount, CORE_SYMBOL), _self);
+    int64_t total_bonus = total_amount - total_guarantee;
 
+    //整批只做一次bancor兑换，KEY按各自的bonus比例分配
     auto key_out = asset(0, KEY_SYMBOL);
     const auto& market = keymarket.get(KEY_SYMBOL, "key market does not exist");
     keymarket.modify( market, 0, [&]( auto& km ) {
-        key_out = km.convert( asset(bonus_amount, CORE_SYMBOL), KEY_SYMBOL);
+        key_out = km.convert( asset(total_bonus, CORE_SYMBOL), KEY_SYMBOL);
     });
+    refresh_ladder();
     eosio_assert( key_out.amount > 0, "must reserve a positive amount" );
-    add_balance(participator, key_out, _self);
+
+    int64_t guaranteed_delta = 0;
+    int64_t key_left = key_out.amount;
+    uint64_t claim_index = get_claim_index();
+    for(size_t i = 0; i < deposits.size(); i++){
+        int64_t key_amount = key_left;
+        if(i + 1 < deposits.size()){
+            int64_t bonus_amount = deposits[i].quantity.amount - guarantee_amounts[i];
+            key_amount = (int64_t)((uint128_t)key_out.amount * bonus_amount / total_bonus);
+        }
+        eosio_assert(key_amount >= 0 && key_amount <= key_left, "key share abnormity");
+        key_left -= key_amount;
+        guaranteed_delta += deposit_balance(deposits[i].beneficiary, guarantee_amounts[i], key_amount, claim_index);
+    }
+
+    add_to_shard(from, total_guarantee, total_bonus, guaranteed_delta);
+    RECORD_METRIC(batchdeposit, deposits.size());
+
+    if(credit_itr->balance.amount == total_amount){
+        credits.erase(credit_itr);
+    }else{
+        credits.modify(credit_itr, 0, [&](auto& c){
+            c.balance.amount -= total_amount;
+        });
+    }
+}
+
+void hbtcoop::withdrawcredit(account_name owner){
+    require_auth(owner);
+
+    //尚未分配的批量额度全部退回转账人
+    auto credit_itr = credits.find(owner);
+    eosio_assert(credit_itr != credits.end(), "no batch transfer found");
+    action(
+        permission_level{_self, N(active)},
+        N(eosio.token), N(transfer),
+        std::make_tuple(_self, owner, credit_itr->balance, std::string("Withdraw batch credit"))
+    ).send();
+    credits.erase(credit_itr);
 }
 
 void hbtcoop::sellkey(account_name account, asset key_quantity){
@@ -198,24 +626,25 @@ void hbtcoop::sellkey(account_name account, asset key_quantity){
     keymarket.modify(market, 0, [&](auto& km){
         tokens_out = km.convert(key_quantity, CORE_SYMBOL);
     });
+    refresh_ladder();
     eosio_assert(tokens_out.amount > 0, "token amount too small to transfer");
+    RECORD_METRIC(sellkey, 1);
     action(
         permission_level{_self, N(active)},
         N(eosio.token), N(transfer),
-        std::make_tuple(_self, account, tokens_out, std::string("sell "+std::to_string(key_quantity.amount)+" key"))
+        std::make_tuple(_self, account, tokens_out, memo_writer().append("sell ").append_int(key_quantity.amount).append(" key").str())
     ).send();
 
     auto glb = global.begin();
     eosio_assert(glb != global.end(), "the global table does not exist");
-    eosio_assert(glb->bonus_pool.amount >= tokens_out.amount, "bancor convert error!");
-    global.modify(glb, 0, [&](auto& gl){
-        gl.bonus_pool.amount -= tokens_out.amount;
-    });
+    eosio_assert(get_pool_totals(glb).bonus_pool >= tokens_out.amount, "bancor convert error!");
+    add_to_shard(account, 0, -tokens_out.amount, 0);
 
     sub_balance(account, key_quantity);
-    auto accounts_itr = accounts.find(account);
-    if(accounts_itr->asset_list.size() == 0){
-        accounts.erase(accounts_itr);
+    balances_table balances(_self, account);
+    auto member_itr = balances.find(account);
+    if(member_itr->empty()){
+        erase_member(balances, member_itr);
     }
 }
 
@@ -236,155 +665,638 @@ void hbtcoop::transfer(account_name from, account_name to, asset quantity, strin
     sub_balance(from, quantity);
     add_balance(to, quantity, from);
 
-    auto accounts_itr = accounts.find(from);
-    if(accounts_itr->asset_list.size() == 0){
-        accounts.erase(accounts_itr);
+    balances_table balances(_self, from);
+    auto member_itr = balances.find(from);
+    if(member_itr->empty()){
+        erase_member(balances, member_itr);
     }
 }
 
-bool hbtcoop::has_balance(account_name owner, asset currency){
+hbtcoop::balances_table::const_iterator hbtcoop::migrate_account(balances_table& balances){
+    account_name owner = balances.get_scope();
     auto accounts_itr = accounts.find(owner);
     if(accounts_itr == accounts.end()){
-        return false;
+        return balances.end();
     }
 
-    asset_entry asset_e;
-    asset_e.balance = currency;
-    auto list_itr = std::find(accounts_itr->asset_list.begin(), accounts_itr->asset_list.end(), asset_e);
-    if(list_itr == accounts_itr->asset_list.end()){
-        return false;
-    } else {
-        return true;
+    auto member_itr = balances.emplace(_self, [&](auto& m){
+        m.account = accounts_itr->account;
+        m.join_time = accounts_itr->join_time;
+        //旧版账户的赔付已在升级前逐个扣减，从claim_index为0时开始结算
+        m.claim_snapshot = 0;
+        for(const auto& e : accounts_itr->asset_list){
+            m.balance(e.balance.symbol) = e.balance.amount;
+        }
+    });
+    sync_registry(owner, 0, member_itr->join_time);
+    for(const auto& e : accounts_itr->vote_list){
+        auto case_itr = find_case(e.case_id);
+        if(case_itr == proposals.end() || case_itr->start_time + TIME_WINDOW_FOR_VOTE < now()){
+            continue;
+        }
+        ballots_table ballots(_self, e.case_id);
+        if(ballots.find(owner) != ballots.end()){
+            continue;
+        }
+        ballots.emplace(_self, [&](auto& b){
+            b.voter = owner;
+            b.weight = member_itr->stake_balance;
+            b.agreed = e.agreed;
+        });
     }
+    accounts.erase(accounts_itr);
+    return member_itr;
 }
 
-void hbtcoop::sub_balance(account_name owner, asset value){
-    auto accounts_itr = accounts.find(owner);
-    eosio_assert(accounts_itr != accounts.end(), "account does not exist in this contract");
+hbtcoop::balances_table::const_iterator hbtcoop::find_member(balances_table& balances){
+    account_name owner = balances.get_scope();
+    auto member_itr = balances.find(owner);
+    if(member_itr == balances.end()){
+        //旧版accounts表中尚未迁移的账户在首次访问时迁移
+        member_itr = migrate_account(balances);
+    }
+    return member_itr;
+}
+
+void hbtcoop::sync_registry(account_name owner, time old_join_time, time new_join_time){
+    //只登记担保账户，join_time不变时不读写
+    if(old_join_time == new_join_time){
+        return;
+    }
+    if(new_join_time == 0){
+        registry.erase(registry.get(owner, "account is not registered"));
+        return;
+    }
+    if(old_join_time == 0){
+        registry.emplace(_self, [&](auto& r){
+            r.account = owner;
+            r.join_time = new_join_time;
+        });
+        return;
+    }
+    registry.modify(registry.get(owner, "account is not registered"), 0, [&](auto& r){
+        r.join_time = new_join_time;
+    });
+}
 
-    asset_entry asset_e;
-    asset_e.balance = value;
-    auto list_itr = std::find(accounts_itr->asset_list.begin(), accounts_itr->asset_list.end(), asset_e);
-    eosio_assert(list_itr != accounts_itr->asset_list.end(), "account does not have this asset");
-    eosio_assert(list_itr->balance.amount >= value.amount, "overdrawn balance");
+void hbtcoop::erase_member(balances_table& balances, balances_table::const_iterator member_itr){
+    sync_registry(member_itr->account, member_itr->join_time, 0);
+    balances.erase(member_itr);
+}
 
-    if(list_itr->balance.amount == value.amount){
-        accounts.modify(accounts_itr, owner, [&](auto& a){
-            a.asset_list.erase(list_itr);
+void hbtcoop::migrate(uint64_t max_rows){
+    require_auth(_self);
+    eosio_assert(max_rows > 0, "max_rows must be positive");
+
+    //依次迁移旧版cases、accounts表，每行计一次
+    uint64_t i = 0;
+    for(; i < max_rows; i++){
+        auto cases_itr = cases.begin();
+        if(cases_itr != cases.end()){
+            migrate_case(cases_itr->case_id);
+            continue;
+        }
+        auto accounts_itr = accounts.begin();
+        if(accounts_itr == accounts.end()){
+            break;
+        }
+        balances_table balances(_self, accounts_itr->account);
+        migrate_account(balances);
+    }
+    RECORD_METRIC(migrate, i);
+}
+
+hbtcoop::proposals_table::const_iterator hbtcoop::migrate_case(uint64_t case_id){
+    auto cases_itr = cases.find(case_id);
+    if(cases_itr == cases.end()){
+        return proposals.end();
+    }
+
+    auto case_itr = proposals.emplace(_self, [&](auto& c){
+        c.case_id = cases_itr->case_id;
+        c.case_name = cases_itr->case_name;
+        c.proposer = cases_itr->proposer;
+        c.required_fund = cases_itr->required_fund.amount;
+        c.start_time = cases_itr->start_time;
+        c.vote_yes = cases_itr->vote_yes.amount;
+        c.vote_no = cases_itr->vote_no.amount;
+    });
+    cases.erase(cases_itr);
+    enqueue_case(case_id, case_itr->start_time + TIME_WINDOW_FOR_VOTE + 1, _self);
+    return case_itr;
+}
+
+hbtcoop::proposals_table::const_iterator hbtcoop::find_case(uint64_t case_id){
+    auto case_itr = proposals.find(case_id);
+    if(case_itr == proposals.end()){
+        //旧版cases表中尚未迁移的案例在首次访问时迁移
+        case_itr = migrate_case(case_id);
+    }
+    return case_itr;
+}
+
+bool hbtcoop::vote_needed(uint64_t case_id){
+    //案例已结束或已过投票期，投票不再需要
+    auto case_itr = proposals.find(case_id);
+    if(case_itr != proposals.end()){
+        return case_itr->start_time + TIME_WINDOW_FOR_VOTE >= now();
+    }
+    auto cases_itr = cases.find(case_id);
+    return cases_itr != cases.end() && cases_itr->start_time + TIME_WINDOW_FOR_VOTE >= now();
+}
+
+void hbtcoop::gcvotes(uint64_t max_rows){
+    eosio_assert(max_rows > 0, "max_rows must be positive");
+
+    auto cursor_itr = gccursor.find(0);
+    if(cursor_itr == gccursor.end()){
+        cursor_itr = gccursor.emplace(_self, [&](auto& c){
+            c.id = 0;
         });
-    }else{
-        asset_e.balance.amount = list_itr->balance.amount - value.amount;
-        accounts.modify(accounts_itr, owner, [&](auto& a){
-            a.asset_list.erase(list_itr);
-            a.asset_list.push_back(asset_e);
+    }
+    account_name next_account = cursor_itr->next_account;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+
+    //遍历旧版accounts表中的vote_list，每行计一次
+    uint64_t i = 0;
+    auto accounts_itr = accounts.lower_bound(next_account);
+    for(; i < max_rows && accounts_itr != accounts.end(); i++, accounts_itr++){
+        next_account = accounts_itr->account + 1;
+        auto stale = [&](const vote_entry& e){ return !vote_needed(e.case_id); };
+        auto count = std::count_if(accounts_itr->vote_list.begin(), accounts_itr->vote_list.end(), stale);
+        if(count == 0){
+            continue;
+        }
+        auto size = pack_size(*accounts_itr);
+        accounts.modify(accounts_itr, 0, [&](auto& a){
+            a.vote_list.erase(std::remove_if(a.vote_list.begin(), a.vote_list.end(), stale), a.vote_list.end());
         });
+        entries += count;
+        bytes += size - pack_size(*accounts_itr);
     }
+
+    if(accounts_itr == accounts.end()){
+        //一轮结束，下次从头开始
+        next_account = 0;
+    }
+    gccursor.modify(cursor_itr, 0, [&](auto& c){
+        c.next_account = next_account;
+        c.entries += entries;
+        c.bytes += bytes;
+    });
+    print("gcvotes reclaimed ", entries, " entries, ", bytes, " bytes");
+    RECORD_METRIC(gcvotes, i);
+}
+
+bool hbtcoop::has_balance(account_name owner, asset currency){
+    if(currency.symbol == CORE_SYMBOL){
+        settle_guarantee(owner);
+    }
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    if(member_itr == balances.end()){
+        return false;
+    }
+    return member_itr->balance(currency.symbol) > 0;
+}
+
+void hbtcoop::sub_balance(account_name owner, asset value){
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    eosio_assert(member_itr != balances.end(), "account does not exist in this contract");
+    eosio_assert(member_itr->balance(value.symbol) > 0, "account does not have this asset");
+    eosio_assert(member_itr->balance(value.symbol) >= value.amount, "overdrawn balance");
+
+    balances.modify(member_itr, owner, [&](auto& m){
+        m.balance(value.symbol) -= value.amount;
+    });
 }
 
 void hbtcoop::add_balance(account_name owner, asset value, account_name ram_payer)
 {
-    asset_entry asset_e;
-    asset_e.balance = value;
-    auto accounts_itr = accounts.find(owner);
-    if(accounts_itr == accounts.end()){
-        accounts_itr = accounts.emplace(ram_payer, [&](auto& a){
-            a.account = owner;
-            a.asset_list.push_back(asset_e);
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    if(member_itr == balances.end()){
+        member_itr = balances.emplace(ram_payer, [&](auto& m){
+            m.account = owner;
+            m.balance(value.symbol) = value.amount;
             if(value.symbol == CORE_SYMBOL){
-                a.join_time = now();
+                m.join_time = now();
+                m.claim_snapshot = get_claim_index();
             }
         });
+        sync_registry(owner, 0, member_itr->join_time);
     } else {
-        auto list_itr = std::find(accounts_itr->asset_list.begin(), accounts_itr->asset_list.end(), asset_e);
-	if(list_itr == accounts_itr->asset_list.end()){
-            accounts.modify(accounts_itr, ram_payer, [&](auto& a){
-                a.asset_list.push_back(asset_e);
-                if(value.symbol == CORE_SYMBOL){
-                    a.join_time = now();
-                }
-            });
-        } else {
-            asset_e.balance.amount = list_itr->balance.amount + value.amount;
-            accounts.modify(accounts_itr, ram_payer, [&](auto& a){
-                a.asset_list.erase(list_itr);
-                a.asset_list.push_back(asset_e);
-            });
+        bool join = (value.symbol == CORE_SYMBOL && member_itr->guarantee_balance == 0);
+        time old_join_time = member_itr->join_time;
+        balances.modify(member_itr, ram_payer, [&](auto& m){
+            m.balance(value.symbol) += value.amount;
+            if(join){
+                m.join_time = now();
+                m.claim_snapshot = get_claim_index();
+            }
+        });
+        sync_registry(owner, old_join_time, member_itr->join_time);
+    }
+}
+
+int64_t hbtcoop::deposit_balance(account_name owner, int64_t guarantee_amount, int64_t key_amount, uint64_t claim_index){
+    eosio_assert(guarantee_amount > 0, "guarantee amount must be positive");
+
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    if(member_itr == balances.end()){
+        balances.emplace(_self, [&](auto& m){
+            m.account = owner;
+            m.join_time = now();
+            m.claim_snapshot = claim_index;
+            m.guarantee_balance = guarantee_amount;
+            m.key_balance = key_amount;
+        });
+        sync_registry(owner, 0, now());
+        return 1;
+    }
+
+    //结算与充值在同一次写入中完成，返回担保账户数的变化
+    int64_t guaranteed_delta = 0;
+    time old_join_time = member_itr->join_time;
+    balances.modify(member_itr, _self, [&](auto& m){
+        if(m.join_time > 0){
+            uint64_t debt = claim_index - m.claim_snapshot;
+            if((uint64_t)m.guarantee_balance > debt){
+                m.guarantee_balance -= debt;
+            }else{
+                m.guarantee_balance = 0;
+                m.join_time = 0;
+                guaranteed_delta -= 1;
+            }
+        }
+        if(m.join_time == 0){
+            m.join_time = now();
+            guaranteed_delta += 1;
         }
+        m.claim_snapshot = claim_index;
+        m.guarantee_balance += guarantee_amount;
+        m.key_balance += key_amount;
+    });
+    sync_registry(owner, old_join_time, member_itr->join_time);
+    return guaranteed_delta;
+}
+
+void hbtcoop::settle_guarantee(account_name owner){
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    if(member_itr == balances.end() || member_itr->join_time == 0){
+        return;
+    }
+    uint64_t claim_index = get_claim_index();
+    uint64_t debt = claim_index - member_itr->claim_snapshot;
+    if(debt == 0){
+        return;
+    }
+
+    if((uint64_t)member_itr->guarantee_balance > debt){
+        balances.modify(member_itr, 0, [&](auto& m){
+            m.guarantee_balance -= debt;
+            m.claim_snapshot = claim_index;
+        });
+        return;
+    }
+
+    //担保金已扣完，退出互助
+    add_to_shard(owner, 0, 0, -1);
+    if(member_itr->key_balance == 0 && member_itr->stake_balance == 0){
+        erase_member(balances, member_itr);
+    }else{
+        sync_registry(owner, member_itr->join_time, 0);
+        balances.modify(member_itr, 0, [&](auto& m){
+            m.guarantee_balance = 0;
+            m.join_time = 0;
+            m.claim_snapshot = 0;
+        });
     }
 }
 
-void hbtcoop::stakekey(account_name account, asset key_quantity){
-    require_auth(account);
-    eosio_assert(key_quantity.amount > 0, "quantity cannot be negative");
-    eosio_assert(key_quantity.symbol == KEY_SYMBOL, "this asset is not supported or the symbol precision mismatch");
+void hbtcoop::settle(account_name owner){
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    eosio_assert(member_itr != balances.end(), "account does not exist in this contract");
+    eosio_assert(member_itr->join_time > 0, "account is not guaranteed");
+    settle_guarantee(owner);
+}
 
-    sub_balance(account, key_quantity);
-    add_balance(account, asset(key_quantity.amount, STAKE_SYMBOL), account);
+void hbtcoop::settlebatch(uint64_t from_join_time, uint64_t max_rows){
+    eosio_assert(max_rows > 0, "max_rows must be positive");
+
+    //按加入时间遍历登记表中的担保账户
+    auto join_index = registry.get_index<N(byjoin)>();
+    auto registry_itr = join_index.lower_bound((uint128_t)from_join_time << 64);
+    uint64_t i = 0;
+    for(; i < max_rows && registry_itr != join_index.end(); i++){
+        account_name owner = registry_itr->account;
+        registry_itr ++;
+        settle_guarantee(owner);
+    }
+    RECORD_METRIC(settlebatch, i);
+}
+
+int64_t hbtcoop::voting_power(account_name owner){
+    int64_t power = 0;
+    if(delegations.find(owner) == delegations.end()){
+        balances_table balances(_self, owner);
+        auto member_itr = find_member(balances);
+        if(member_itr != balances.end()){
+            power = member_itr->stake_balance;
+        }
+    }
+    auto proxy_itr = proxies.find(owner);
+    if(proxy_itr != proxies.end()){
+        power += proxy_itr->delegated;
+    }
+    return power;
+}
+
+void hbtcoop::adjust_power(account_name owner, int64_t delta, account_name ram_payer){
+    //须在质押量和委托关系变化之前调用
+    stakechk_table checkpoints(_self, owner);
+    if(checkpoints.begin() == checkpoints.end()){
+        //第一次变化前的投票权
+        checkpoints.emplace(ram_payer, [&](auto& c){
+            c.time = 0;
+            c.stake = voting_power(owner);
+        });
+    }
+
+    uint64_t t = now();
+    auto last = checkpoints.end();
+    last --;
+    int64_t power = last->stake + delta;
+    if(last->time == t){
+        checkpoints.modify(last, 0, [&](auto& c){
+            c.stake = power;
+        });
+    }else{
+        checkpoints.emplace(ram_payer, [&](auto& c){
+            c.time = t;
+            c.stake = power;
+        });
+    }
 
-    auto accounts_itr = accounts.find(account);
+    //投票期内的案例最早在cutoff之后开始，只需保留cutoff时的投票权及之后的变化
+    if(t <= TIME_WINDOW_FOR_VOTE + 1){
+        return;
+    }
+    uint64_t cutoff = t - TIME_WINDOW_FOR_VOTE - 1;
+    auto keep = checkpoints.upper_bound(cutoff);
+    if(keep == checkpoints.begin()){
+        return;
+    }
+    keep --;
+    for(auto itr = checkpoints.begin(); itr != keep; ){
+        itr = checkpoints.erase(itr);
+    }
+}
+
+int64_t hbtcoop::power_at(account_name owner, uint64_t time){
+    stakechk_table checkpoints(_self, owner);
+    auto itr = checkpoints.upper_bound(time);
+    if(itr == checkpoints.begin()){
+        if(itr != checkpoints.end()){
+            return 0;
+        }
+        //投票权从未变化过
+        return voting_power(owner);
+    }
+    itr --;
+    return itr->stake;
+}
 
-    if(accounts_itr->vote_list.size() == 0)
+void hbtcoop::shift_power(account_name owner, int64_t delta){
+    //质押量变化前调用，已委托的记到代理人名下
+    auto delegation_itr = delegations.find(owner);
+    if(delegation_itr == delegations.end()){
+        adjust_power(owner, delta, owner);
         return;
+    }
+    account_name proxy = delegation_itr->proxy;
+    adjust_power(proxy, delta, owner);
+    proxies.modify(proxies.get(proxy, "proxy does not exist"), 0, [&](auto& p){
+        p.delegated += delta;
+    });
+}
 
-   
-    for(auto list_itr = accounts_itr->vote_list.begin(); list_itr != accounts_itr->vote_list.end(); list_itr ++){
-        auto case_itr = cases.find(list_itr->case_id);
-        if(case_itr == cases.end()){
-            accounts.modify(accounts_itr, account, [&]( auto& v){
-                v.vote_list.erase(list_itr);
-            });        
+void hbtcoop::delegate(account_name owner, account_name proxy){
+    require_auth(owner);
+    eosio_assert(owner != proxy, "cannot delegate to self");
+    eosio_assert(is_account(proxy), "proxy account does not exist");
+    eosio_assert(delegations.find(proxy) == delegations.end(), "proxy has delegated its own stake");
+    eosio_assert(proxies.find(owner) == proxies.end(), "a proxy can not delegate");
+
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    int64_t stake = member_itr == balances.end() ? 0 : member_itr->stake_balance;
+
+    auto delegation_itr = delegations.find(owner);
+    if(delegation_itr != delegations.end()){
+        account_name old_proxy = delegation_itr->proxy;
+        eosio_assert(old_proxy != proxy, "already delegated to this proxy");
+        adjust_power(old_proxy, -stake, owner);
+        const auto& old_itr = proxies.get(old_proxy, "proxy does not exist");
+        if(old_itr.delegators == 1){
+            proxies.erase(old_itr);
         }else{
-            if(case_itr->start_time + TIME_WINDOW_FOR_VOTE < now()){
-                continue;
-            }
-            if(list_itr->agreed){
-                cases.modify(case_itr, account, [&]( auto& c){
-                    c.vote_yes += asset(key_quantity.amount, STAKE_SYMBOL);
-                });
-            }else{
-                cases.modify(case_itr, account, [&]( auto& c){
-                    c.vote_no += asset(key_quantity.amount, STAKE_SYMBOL);
-                });
-            }
+            proxies.modify(old_itr, 0, [&](auto& p){
+                p.delegated -= stake;
+                p.delegators -= 1;
+            });
         }
+        delegations.modify(delegation_itr, owner, [&](auto& d){
+            d.proxy = proxy;
+        });
+    }else{
+        adjust_power(owner, -stake, owner);
+        delegations.emplace(owner, [&](auto& d){
+            d.owner = owner;
+            d.proxy = proxy;
+        });
+    }
+
+    adjust_power(proxy, stake, owner);
+    auto proxy_itr = proxies.find(proxy);
+    if(proxy_itr == proxies.end()){
+        proxies.emplace(owner, [&](auto& p){
+            p.proxy = proxy;
+            p.delegated = stake;
+            p.delegators = 1;
+        });
+    }else{
+        proxies.modify(proxy_itr, 0, [&](auto& p){
+            p.delegated += stake;
+            p.delegators += 1;
+        });
     }
 }
 
-void hbtcoop::unstakekey(account_name account, asset key_quantity){
-    require_auth(account);
-    eosio_assert(key_quantity.amount > 0, "quantity cannot be negative");
-    eosio_assert(key_quantity.symbol == STAKE_SYMBOL, "this asset is not supported or the symbol precision mismatch");
+void hbtcoop::undelegate(account_name owner){
+    require_auth(owner);
+    auto delegation_itr = delegations.find(owner);
+    eosio_assert(delegation_itr != delegations.end(), "stake is not delegated");
 
-    sub_balance(account, key_quantity);
-    add_balance(account, asset(key_quantity.amount, KEY_SYMBOL), account);
+    balances_table balances(_self, owner);
+    auto member_itr = find_member(balances);
+    int64_t stake = member_itr == balances.end() ? 0 : member_itr->stake_balance;
 
-    auto accounts_itr = accounts.find(account);
+    account_name proxy = delegation_itr->proxy;
+    adjust_power(proxy, -stake, owner);
+    const auto& proxy_itr = proxies.get(proxy, "proxy does not exist");
+    if(proxy_itr.delegators == 1){
+        proxies.erase(proxy_itr);
+    }else{
+        proxies.modify(proxy_itr, 0, [&](auto& p){
+            p.delegated -= stake;
+            p.delegators -= 1;
+        });
+    }
 
-   
-    if(accounts_itr->vote_list.size() == 0)
+    adjust_power(owner, stake, owner);
+    delegations.erase(delegation_itr);
+}
+
+bool hbtcoop::prune_votes(uint64_t case_id){
+    //每次最多删除VOTE_PRUNE_BATCH条，返回是否已删完
+    uint32_t i = 0;
+    ballots_table ballots(_self, case_id);
+    auto ballot_itr = ballots.begin();
+    for(; i < VOTE_PRUNE_BATCH && ballot_itr != ballots.end(); i++){
+        ballot_itr = ballots.erase(ballot_itr);
+    }
+    RECORD_METRIC(prunevotes, i);
+    return ballot_itr == ballots.end();
+}
+
+void hbtcoop::enqueue_case(uint64_t case_id, time deadline, account_name ram_payer){
+    auto queue_itr = deadlines.find(case_id);
+    if(queue_itr == deadlines.end()){
+        deadlines.emplace(ram_payer, [&](auto& d){
+            d.case_id = case_id;
+            d.deadline = deadline;
+        });
+    }else{
+        deadlines.modify(queue_itr, 0, [&](auto& d){
+            d.deadline = deadline;
+        });
+    }
+}
+
+void hbtcoop::close_case(proposals_table::const_iterator case_itr){
+    uint64_t case_id = case_itr->case_id;
+    proposals.erase(case_itr);
+    if(prune_votes(case_id)){
+        auto queue_itr = deadlines.find(case_id);
+        if(queue_itr != deadlines.end()){
+            deadlines.erase(queue_itr);
+        }
         return;
+    }
+    //剩余的投票由finalize继续删除
+    enqueue_case(case_id, 0, _self);
+    schedule_finalize(0, 0, 0);
+}
 
-    
-    for(auto list_itr = accounts_itr->vote_list.begin(); list_itr != accounts_itr->vote_list.end(); list_itr ++){
-        auto case_itr = cases.find(list_itr->case_id);
-        if(case_itr == cases.end()){
-            accounts.modify(accounts_itr, account, [&]( auto& a){
-                a.vote_list.erase(list_itr);
-            });
-        }else{
-            if(case_itr->start_time + TIME_WINDOW_FOR_VOTE >= now()){
-                if(list_itr->agreed){
-                    cases.modify(case_itr, account, [&]( auto& c){
-                        c.vote_yes -= asset(key_quantity.amount, STAKE_SYMBOL);
-                    });
-                }else{  
-                    cases.modify(case_itr, account, [&]( auto& c){
-                        c.vote_no -= asset(key_quantity.amount, STAKE_SYMBOL);
-                    });
-                }
+void hbtcoop::schedule_finalize(uint64_t tag, uint32_t delay, uint8_t attempt){
+    //同一tag只保留一个延迟交易，attempt为失败后重试的次数，重试时只处理队首
+    uint128_t sender_id = ((uint128_t)N(finalize) << 64) | ((uint128_t)tag << 8) | attempt;
+    uint64_t max_rows = attempt > 0 ? 1 : FINALIZE_BATCH;
+    transaction out;
+    out.actions.emplace_back(permission_level{_self, N(active)}, _self, N(finalize), std::make_tuple(max_rows));
+    out.delay_sec = delay;
+    out.send(sender_id, _self, true);
+}
+
+void hbtcoop::handleError(const onerror& error){
+    if((uint64_t)(error.sender_id >> 64) != N(finalize)){
+        return;
+    }
+    uint8_t attempt = (uint8_t)error.sender_id;
+    uint64_t tag = (uint64_t)error.sender_id >> 8;
+    if(attempt < FINALIZE_MAX_RETRIES){
+        schedule_finalize(tag, FINALIZE_RETRY_DELAY, attempt + 1);
+        return;
+    }
+
+    //队首多次重试仍然失败，移出队列，案例留给execproposal、delproposal处理，其余案例继续结束
+    auto deadline_index = deadlines.get_index<N(bydeadline)>();
+    auto queue_itr = deadline_index.begin();
+    if(queue_itr != deadline_index.end() && queue_itr->deadline <= now()){
+        deadline_index.erase(queue_itr);
+    }
+    queue_itr = deadline_index.begin();
+    if(queue_itr != deadline_index.end() && queue_itr->deadline <= now()){
+        schedule_finalize(tag, 0, 0);
+    }
+}
+
+void hbtcoop::finalize(uint64_t max_rows){
+    eosio_assert(max_rows > 0, "max_rows must be positive");
+
+    auto deadline_index = deadlines.get_index<N(bydeadline)>();
+    uint64_t i = 0;
+    for(; i < max_rows; i++){
+        auto queue_itr = deadline_index.begin();
+        if(queue_itr == deadline_index.end() || queue_itr->deadline > now()){
+            break;
+        }
+
+        auto case_itr = find_case(queue_itr->case_id);
+        if(case_itr == proposals.end()){
+            //案例已结束，继续删除剩余的投票
+            if(prune_votes(queue_itr->case_id)){
+                deadline_index.erase(queue_itr);
             }
+            continue;
+        }
+
+        if(pay_case(case_itr) == nullptr){
+            continue;
+        }
+        if(case_itr->vote_yes <= case_itr->vote_no){
+            close_case(case_itr);
+        }else{
+            //通过但暂时无法赔付，留给提案人处理
+            deadline_index.erase(queue_itr);
         }
     }
+
+    RECORD_METRIC(finalize, i);
+
+    //本次未处理完，继续处理剩余的部分
+    auto queue_itr = deadline_index.begin();
+    if(i == max_rows && queue_itr != deadline_index.end() && queue_itr->deadline <= now()){
+        schedule_finalize(0, 0, 0);
+    }
+}
+
+void hbtcoop::stakekey(account_name account, asset key_quantity){
+    require_auth(account);
+    eosio_assert(key_quantity.amount > 0, "quantity cannot be negative");
+    eosio_assert(key_quantity.symbol == KEY_SYMBOL, "this asset is not supported or the symbol precision mismatch");
+
+    shift_power(account, key_quantity.amount);
+    sub_balance(account, key_quantity);
+    add_balance(account, asset(key_quantity.amount, STAKE_SYMBOL), account);
+    RECORD_METRIC(stakekey, 1);
+}
+
+void hbtcoop::unstakekey(account_name account, asset key_quantity){
+    require_auth(account);
+    eosio_assert(key_quantity.amount > 0, "quantity cannot be negative");
+    eosio_assert(key_quantity.symbol == STAKE_SYMBOL, "this asset is not supported or the symbol precision mismatch");
+
+    shift_power(account, -key_quantity.amount);
+    sub_balance(account, key_quantity);
+    add_balance(account, asset(key_quantity.amount, KEY_SYMBOL), account);
+    RECORD_METRIC(unstakekey, 1);
 }
 
 void hbtcoop::propose(account_name proposer, name case_name, asset required_fund){
@@ -394,257 +1306,223 @@ void hbtcoop::propose(account_name proposer, name case_name, asset required_fund
 
     auto glb = global.begin();
     eosio_assert(glb != global.end(), "the global table does not exist");
-    eosio_assert(glb->guarantee_pool.amount > 0, "the guarantee pool is empty");
+    auto totals = get_pool_totals(glb);
+    eosio_assert(totals.guarantee_pool > 0, "the guarantee pool is empty");
     eosio_assert(required_fund.amount <= glb->max_claim.amount, "required fund can not exceed the max claim fund");
-    eosio_assert(required_fund.amount <= glb->guarantee_pool.amount, "can not require more than guarantee pool");
+    eosio_assert(required_fund.amount <= totals.guarantee_pool, "can not require more than guarantee pool");
     global.modify(glb, 0, [&](auto& gl){
         gl.cases_num += 1;
     });
 
-    const auto& accounts_itr = accounts.get(proposer, "the user does not exist");
     eosio_assert(has_balance(proposer, asset(0, CORE_SYMBOL)), "the user do not have guarantee balance");
-    eosio_assert(accounts_itr.join_time + TIME_WINDOW_FOR_OBSERVATION <= now(), "can not propose in observation period");
+    balances_table balances(_self, proposer);
+    const auto& member = balances.get(proposer, "the user does not exist");
+    eosio_assert(member.join_time + TIME_WINDOW_FOR_OBSERVATION <= now(), "can not propose in observation period");
 
-    cases.emplace(proposer, [&](auto& c) {
+    auto case_itr = proposals.emplace(proposer, [&](auto& c) {
         c.case_id = glb->cases_num;
         c.case_name = case_name;
         c.proposer = proposer;
-        c.required_fund = required_fund;
+        c.required_fund = required_fund.amount;
         c.start_time = now();
-        c.vote_yes = asset(0, STAKE_SYMBOL);
-        c.vote_no = asset(0, STAKE_SYMBOL);
     });
+
+    //投票期结束后自动结束案例
+    enqueue_case(case_itr->case_id, case_itr->start_time + TIME_WINDOW_FOR_VOTE + 1, proposer);
+    schedule_finalize(case_itr->case_id, TIME_WINDOW_FOR_VOTE + 1, 0);
 }
 
-void hbtcoop::approve(account_name account, uint64_t case_id){
-    require_auth(account);
-    const auto& case_itr = cases.get(case_id, "case does not exist");
-    eosio_assert(case_itr.start_time + TIME_WINDOW_FOR_VOTE >= now(), "out of time for vote");
-
-    eosio_assert(has_balance(account, asset(0, STAKE_SYMBOL)), "no stake balance object found");
-    asset_entry asset_e;
-    asset_e.balance = asset(0, STAKE_SYMBOL);
-    auto accounts_itr = accounts.find(account);
-    auto asset_list_itr = std::find(accounts_itr->asset_list.begin(), accounts_itr->asset_list.end(), asset_e);
-
-    vote_entry vote_e;
-    vote_e.case_id = case_id;
-    vote_e.agreed = 1;
-    auto vote_list_itr = std::find(accounts_itr->vote_list.begin(), accounts_itr->vote_list.end(), vote_e);
-    if(vote_list_itr != accounts_itr->vote_list.end()){
-        eosio_assert(vote_list_itr->agreed != 1, "agreeded before");
-        accounts.modify(accounts_itr, account, [&](auto& a){
-            a.vote_list.erase(vote_list_itr);
-            a.vote_list.push_back(vote_e);
-        });
-        cases.modify(case_itr, account, [&](auto& c){
-            c.vote_yes += asset_list_itr->balance;
-            c.vote_no -= asset_list_itr->balance;
+void hbtcoop::cast_vote(account_name account, uint64_t case_id, uint8_t direction){
+    eosio_assert(direction <= VOTE_CANCEL, "invalid vote direction");
+    auto case_itr = find_case(case_id);
+    eosio_assert(case_itr != proposals.end(), "case does not exist");
+    eosio_assert(case_itr->start_time + TIME_WINDOW_FOR_VOTE >= now(), "out of time for vote");
+
+    //先迁移旧版账户，迁移时写入的ballots要在下面查找之前落表
+    balances_table balances(_self, account);
+    find_member(balances);
+
+    ballots_table ballots(_self, case_id);
+    auto ballot_itr = ballots.find(account);
+    if(direction == VOTE_CANCEL){
+        eosio_assert(ballot_itr != ballots.end(), "does not vote this case");
+        int64_t stake = ballot_itr->weight;
+        bool agreed = ballot_itr->agreed == 1;
+        proposals.modify(case_itr, account, [&](auto& c){
+            if(agreed){
+                c.vote_yes -= stake;
+            }else{
+                c.vote_no -= stake;
+            }
+        });
+        ballots.erase(ballot_itr);
+        return;
+    }
+
+    //权重取案例开始前的投票权，之后的质押和委托变化不影响计票
+    int64_t stake = power_at(account, case_itr->start_time - 1);
+    eosio_assert(stake > 0, "no stake before the case started");
+
+    if(ballot_itr != ballots.end()){
+        eosio_assert(ballot_itr->agreed != direction, direction ? "agreeded before" : "unagreeded before");
+        int64_t old_stake = ballot_itr->weight;
+        ballots.modify(ballot_itr, account, [&](auto& b){
+            b.agreed = direction;
+            b.weight = stake;
+        });
+        proposals.modify(case_itr, account, [&](auto& c){
+            if(direction){
+                c.vote_yes += stake;
+                c.vote_no -= old_stake;
+            }else{
+                c.vote_yes -= old_stake;
+                c.vote_no += stake;
+            }
         });
     }else{
-        accounts.modify(accounts_itr, account, [&](auto& a){
-            a.vote_list.push_back(vote_e);
+        ballots.emplace(account, [&](auto& b){
+            b.voter = account;
+            b.weight = stake;
+            b.agreed = direction;
         });
-        cases.modify(case_itr, account, [&](auto& c){
-            c.vote_yes += asset_list_itr->balance;
+        proposals.modify(case_itr, account, [&](auto& c){
+            if(direction){
+                c.vote_yes += stake;
+            }else{
+                c.vote_no += stake;
+            }
         });
     }
 }
 
+void hbtcoop::approve(account_name account, uint64_t case_id){
+    require_auth(account);
+    cast_vote(account, case_id, 1);
+}
+
 void hbtcoop::unapprove(account_name account, uint64_t case_id){
     require_auth(account);
-    const auto& case_itr = cases.get(case_id, "case does not exist");
-    eosio_assert(case_itr.start_time + TIME_WINDOW_FOR_VOTE >= now(), "out of time for vote");
-
-    eosio_assert(has_balance(account, asset(0, STAKE_SYMBOL)), "no stake balance object found");
-    asset_entry asset_e;
-    asset_e.balance = asset(0, STAKE_SYMBOL);
-    auto accounts_itr = accounts.find(account);
-    auto asset_list_itr = std::find(accounts_itr->asset_list.begin(), accounts_itr->asset_list.end(), asset_e);
-
-    vote_entry vote_e;
-    vote_e.case_id = case_id;
-    vote_e.agreed = 0;
-    auto vote_list_itr = std::find(accounts_itr->vote_list.begin(), accounts_itr->vote_list.end(), vote_e);
-    if(vote_list_itr != accounts_itr->vote_list.end()){
-        eosio_assert(vote_list_itr->agreed != 0, "unagreeded before");
-        accounts.modify(accounts_itr, account, [&](auto& a){
-            a.vote_list.erase(vote_list_itr);
-            a.vote_list.push_back(vote_e);
-        });
-        cases.modify(case_itr, account, [&](auto& c){
-            c.vote_yes -= asset_list_itr->balance;
-            c.vote_no += asset_list_itr->balance;
-        });
-    }else{
-        accounts.modify(accounts_itr, account, [&](auto& a){
-            a.vote_list.push_back(vote_e);
-        });
-        cases.modify(case_itr, account, [&](auto& c){
-            c.vote_no += asset_list_itr->balance;
-        }); 
-    }   
+    cast_vote(account, case_id, 0);
 }
 
 void hbtcoop::cancelvote(account_name account, uint64_t case_id){
     require_auth(account);
-    const auto& case_itr = cases.get(case_id, "case does not exist");
-    eosio_assert(case_itr.start_time + TIME_WINDOW_FOR_VOTE >= now(), "out of time for vote");
-
-    eosio_assert(has_balance(account, asset(0, STAKE_SYMBOL)), "no stake balance object found");
-    asset_entry asset_e;
-    asset_e.balance = asset(0, STAKE_SYMBOL);
-    auto accounts_itr = accounts.find(account);
-    auto asset_list_itr = std::find(accounts_itr->asset_list.begin(), accounts_itr->asset_list.end(), asset_e);
-
-    vote_entry vote_e;
-    vote_e.case_id = case_id;
-    vote_e.agreed = 10;
-    auto vote_list_itr = std::find(accounts_itr->vote_list.begin(), accounts_itr->vote_list.end(), vote_e);
-    eosio_assert(vote_list_itr != accounts_itr->vote_list.end(), "does not vote this case");
-    if(vote_list_itr->agreed == 1){
-        cases.modify(case_itr, account, [&](auto& c){
-            c.vote_yes -= asset_list_itr->balance;
-        });
-    }else{
-        cases.modify(case_itr, account, [&](auto& c){
-            c.vote_no -= asset_list_itr->balance;
-        });
-    }
-
-    accounts.modify(accounts_itr, account, [&](auto& a){
-        a.vote_list.erase(vote_list_itr);
-    });
+    cast_vote(account, case_id, VOTE_CANCEL);
 }
 
-string uint64_string(uint64_t input, int p)
-{
-    string result;
-    char c;
-    int q=p;
-    uint8_t base = 10;
-    do
-    {
-        if(q!=0)
-        {
-            c = input % base;
-            input /= base;
-            if (c < 10)
-                c += '0';
-            else
-                c += 'A' - 10;
-        }
-        else
-            c = '.';
-        result = c + result;
-        q--;
-    } while (input);
-
-    if(q >= 0)
-    {
-        while(q > 0)
-        {
-            result = '0' + result;
-            q--;
-        }
-        result = "0." + result;
+void hbtcoop::votebatch(account_name account, vector<case_vote> case_votes){
+    require_auth(account);
+    eosio_assert(case_votes.size() > 0, "empty vote list");
+
+    //每个案例只能出现一次，保证每个案例行只写一次
+    vector<uint64_t> case_ids;
+    case_ids.reserve(case_votes.size());
+    for(const auto& v : case_votes){
+        case_ids.push_back(v.case_id);
     }
-    return result;
-}
+    std::sort(case_ids.begin(), case_ids.end());
+    eosio_assert(std::adjacent_find(case_ids.begin(), case_ids.end()) == case_ids.end(), "duplicate case in vote list");
 
-void hbtcoop::execproposal(account_name account, uint64_t case_id){
-    require_auth(account);
+    for(const auto& v : case_votes){
+        cast_vote(account, v.case_id, v.direction);
+    }
+    RECORD_METRIC(votebatch, case_votes.size());
+}
 
-    auto case_itr = cases.find(case_id);
-    eosio_assert(case_itr != cases.end(), "case does not exist");
-    eosio_assert(case_itr->start_time + TIME_WINDOW_FOR_VOTE < now(), "voting has not been completed");
+const char* hbtcoop::pay_case(proposals_table::const_iterator case_itr){
+    //不满足赔付条件时返回原因，不做任何修改
     auto glb = global.begin();
     eosio_assert(glb != global.end(), "the global table does not exist");
-    eosio_assert(glb->guarantee_pool.amount > 0, "guarantee pool empty");
+    auto totals = get_pool_totals(glb);
+    if(totals.guarantee_pool <= 0) return "guarantee pool empty";
     const auto& market = keymarket.get(KEY_SYMBOL, "key market does not exist");
-    eosio_assert(case_itr->vote_yes.amount > case_itr->vote_no.amount, "insufficient proportion of yes");
+    if(case_itr->vote_yes <= case_itr->vote_no) return "insufficient proportion of yes";
 
-    eosio_assert(market.supply.amount - KEY_INIT_SUPPLY >= case_itr->vote_yes.amount + case_itr->vote_no.amount, "prevent speculation through KEY manipulation");
-    auto vote_amount = (uint64_t)((double)case_itr->vote_yes.amount/(double)(market.supply.amount - KEY_INIT_SUPPLY)*case_itr->required_fund.amount);
-    uint64_t user_num = glb->guaranteed_accounts;
+    if(market.supply.amount - KEY_INIT_SUPPLY < case_itr->vote_yes + case_itr->vote_no) return "prevent speculation through KEY manipulation";
+    auto vote_amount = (uint64_t)((double)case_itr->vote_yes/(double)(market.supply.amount - KEY_INIT_SUPPLY)*case_itr->required_fund);
+    uint64_t user_num = totals.guaranteed_accounts;
+    if(user_num == 0) return "no guaranteed accounts";
     auto single_amount = (uint64_t)((double)vote_amount / (double)user_num);
-    eosio_assert(single_amount >= 1, "too little to transfer");
-
-    asset_entry asset_e;
-    asset_e.balance = asset(single_amount, CORE_SYMBOL);
-    uint64_t transfer_amount = 0;
-    for(auto accounts_itr = accounts.begin(); accounts_itr != accounts.end(); ){
-        if(accounts_itr->join_time > 0){
-            auto asset_list_itr = std::find(accounts_itr->asset_list.begin(), accounts_itr->asset_list.end(), asset_e);
-            if(asset_list_itr->balance.amount > asset_e.balance.amount){
-                transfer_amount += asset_e.balance.amount;
-                sub_balance(accounts_itr->account, asset_e.balance);
-            }else{
-                transfer_amount += asset_list_itr->balance.amount;
-                sub_balance(accounts_itr->account, asset_list_itr->balance);
-                global.modify(glb, 0, [&](auto& gl){
-                    gl.guaranteed_accounts -= 1;
-                });
-                if(accounts_itr->asset_list.size() == 0){
-                    accounts.erase(accounts_itr);
-                    continue;
-                }else{
-                    accounts.modify(accounts_itr, account, [&](auto& a){
-                        a.join_time = 0;
-                    });
-                }
-            }
-        }
-        accounts_itr ++;
-    }
-    eosio_assert(transfer_amount <= glb->guarantee_pool.amount, "internal error");
-
-    string memo = "case_id:";
-    memo.append(std::to_string(case_itr->case_id));
-    memo.append(", vote_yes:");
-    memo.append(std::to_string(case_itr->vote_yes.amount));
-    memo.append("STKEY, vote_no:");
-    memo.append(std::to_string(case_itr->vote_no.amount));
-    memo.append("STKEY, KEY supply:");
-    memo.append(std::to_string(market.supply.amount - KEY_INIT_SUPPLY));
-    memo.append("KEY, vote funding:");
-    memo.append(uint64_string(vote_amount, 4));
-    memo.append("EOS, interdependent user:");
-    memo.append(std::to_string(user_num));
-    memo.append(", each contribute:");
-    memo.append(uint64_string(single_amount, 4));
-    memo.append("EOS, actual funding:");
-    memo.append(uint64_string(transfer_amount, 4));
-    memo.append("EOS");
+    if(single_amount < 1) return "too little to transfer";
+
+    //不再逐个扣减账户，只累加claim_index，账户在下次被访问时按差值结算
+    //赔付按single_amount * user_num从资金池支出：担保金不足single_amount的账户结算时只扣到0，
+    //差额由资金池承担，而旧版只赔付各账户实际扣到的金额之和
+    uint64_t transfer_amount = single_amount * user_num;
+    if(transfer_amount > (uint64_t)totals.guarantee_pool){
+        transfer_amount = totals.guarantee_pool;
+    }
 
     action(
         permission_level{_self, N(active)},
         N(eosio.token), N(transfer),
-        std::make_tuple(_self, case_itr->proposer, asset(transfer_amount, CORE_SYMBOL), memo)
+        std::make_tuple(_self, case_itr->proposer, asset(transfer_amount, CORE_SYMBOL),
+                        memo_writer().append("case_id:").append_uint(case_itr->case_id).str())
+    ).send();
+
+    //赔付明细以caserecpt通知发出，下游直接解码字段，不必解析memo
+    action(
+        permission_level{_self, N(active)},
+        _self, N(caserecpt),
+        std::make_tuple(case_itr->case_id, case_itr->proposer,
+                        asset(case_itr->vote_yes, STAKE_SYMBOL), asset(case_itr->vote_no, STAKE_SYMBOL),
+                        asset(market.supply.amount - KEY_INIT_SUPPLY, KEY_SYMBOL),
+                        asset(vote_amount, CORE_SYMBOL), user_num,
+                        asset(single_amount, CORE_SYMBOL), asset(transfer_amount, CORE_SYMBOL))
     ).send();
 
     global.modify(glb, 0, [&](auto& gl){
         gl.guarantee_pool.amount -= transfer_amount;
         gl.applied_cases += 1;
     });
-    cases.erase(case_itr);
+    auto claims_itr = claims.find(0);
+    if(claims_itr == claims.end()){
+        claims.emplace(_self, [&](auto& c){
+            c.id = 0;
+            c.claim_index = single_amount;
+        });
+    }else{
+        claims.modify(claims_itr, 0, [&](auto& c){
+            c.claim_index += single_amount;
+        });
+    }
+    close_case(case_itr);
+    return nullptr;
+}
+
+void hbtcoop::execproposal(account_name account, uint64_t case_id){
+    require_auth(account);
+
+    auto case_itr = find_case(case_id);
+    eosio_assert(case_itr != proposals.end(), "case does not exist");
+    eosio_assert(case_itr->start_time + TIME_WINDOW_FOR_VOTE < now(), "voting has not been completed");
+    const char* error = pay_case(case_itr);
+    eosio_assert(error == nullptr, error);
+    RECORD_METRIC(execproposal, 1);
 }
 
 
+void hbtcoop::caserecpt(uint64_t case_id, account_name proposer, asset vote_yes, asset vote_no, asset key_supply,
+                        asset vote_funding, uint64_t member_count, asset each_contribute, asset actual_funding){
+    //只由合约在赔付时内联发出，本身不修改状态
+    require_auth(_self);
+    require_recipient(proposer);
+}
+
 void hbtcoop::delproposal(account_name account, uint64_t case_id){
     require_auth(account);
 
-    auto case_itr = cases.find(case_id);
-    eosio_assert(case_itr != cases.end(), "case does not exist");
+    auto case_itr = find_case(case_id);
+    eosio_assert(case_itr != proposals.end(), "case does not exist");
 
     if(case_itr->proposer == account){
-        cases.erase(case_itr);
+        close_case(case_itr);
         return;
     }
 
     eosio_assert(case_itr->start_time + TIME_WINDOW_FOR_VOTE < now(), "voting has not been completed");
-    eosio_assert(case_itr->vote_yes.amount <= case_itr->vote_no.amount, "passed cases can not be deleted by others");
+    eosio_assert(case_itr->vote_yes <= case_itr->vote_no, "passed cases can not be deleted by others");
 
-    cases.erase(case_itr);
+    close_case(case_itr);
 }
 
@@ -1,6 +1,6 @@
 #include <functional>
 #include <string>
-#include <cmath>
+#include <cstring>
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/transaction.hpp>
 #include <eosiolib/asset.hpp>
@@ -9,15 +9,34 @@
 #define STAKE_SYMBOL S(0,STKEY)
 
 #define KEY_INIT_SUPPLY 1000000
+#define KEY_INIT_RESERVE (100 * 10000)
 
 #define TIME_WINDOW_FOR_VOTE ((uint64_t)(30*24*3600))
 #define TIME_WINDOW_FOR_OBSERVATION ((uint64_t)(6*30*24*3600))
 
+#define VOTE_PRUNE_BATCH 100
+#define VOTE_CANCEL 2
+
+#define FINALIZE_BATCH 20
+#define FINALIZE_RETRY_DELAY ((uint32_t)3600)
+#define FINALIZE_MAX_RETRIES 3
+
+#define GLOBAL_SHARDS 8
+
+#define LADDER_MAX_POINTS 20
+
+//编译时定义HBTCOOP_METRICS才记录各操作的调用次数和工作量，否则不产生任何开销
+#define METRICS_WINDOW ((uint32_t)3600)
+#ifdef HBTCOOP_METRICS
+#define RECORD_METRIC(op, work) record_metric(N(op), work)
+#else
+#define RECORD_METRIC(op, work)
+#endif
+
 using namespace eosio;
 using std::string;
 using namespace std;
 
-typedef double real_type;
 struct transfer_args
 {
     account_name from;
@@ -26,14 +45,43 @@ struct transfer_args
     string memo;
 };
 
+struct deposit_entry
+{
+    account_name beneficiary;
+    asset quantity;
+
+    EOSLIB_SERIALIZE(deposit_entry, (beneficiary)(quantity))
+};
+
+struct case_vote
+{
+    uint64_t case_id;
+    uint8_t  direction;     //1赞成，0反对，VOTE_CANCEL取消
+
+    EOSLIB_SERIALIZE(case_vote, (case_id)(direction))
+};
+
 class hbtcoop: public eosio::contract{
   public:
     hbtcoop(account_name self):
     contract(self),
-    global(_self, _self),
     keymarket(_self, _self),
+    ladder(_self, _self),
+#ifdef HBTCOOP_METRICS
+    metrics(_self, _self),
+#endif
+    accounts(_self, _self),
+    registry(_self, _self),
+    global(_self, _self),
+    claims(_self, _self),
+    shards(_self, _self),
     cases(_self, _self),
-    accounts(_self, _self)
+    gccursor(_self, _self),
+    proposals(_self, _self),
+    deadlines(_self, _self),
+    delegations(_self, _self),
+    proxies(_self, _self),
+    credits(_self, _self)
     {}
 
     ///@abi action
@@ -63,15 +111,63 @@ class hbtcoop: public eosio::contract{
     ///@abi action
     void cancelvote(account_name account, uint64_t case_id);
 
+    ///@abi action
+    void votebatch(account_name account, vector<case_vote> case_votes);
+
+    ///@abi action
+    void delegate(account_name owner, account_name proxy);
+
+    ///@abi action
+    void undelegate(account_name owner);
+
     ///@abi action
     void execproposal(account_name account, uint64_t case_id);
 
     ///@abi action
     void delproposal(account_name account, uint64_t case_id);
 
+    ///@abi action
+    void settle(account_name owner);
+
+    ///@abi action
+    void settlebatch(uint64_t from_join_time, uint64_t max_rows);
+
+    ///@abi action
+    void migrate(uint64_t max_rows);
+
+    ///@abi action
+    void batchdeposit(account_name from, vector<deposit_entry> deposits);
+
+    ///@abi action
+    void withdrawcredit(account_name owner);
+
+    ///@abi action
+    void compact();
+
+    ///@abi action
+    void finalize(uint64_t max_rows);
+
+    ///@abi action
+    void gcvotes(uint64_t max_rows);
+
+    ///@abi action
+    void quote(asset quantity);
+
+    ///@abi action
+    void setladder(vector<asset> points);
+
+    ///@abi action
+    void audit();
+
+    ///@abi action
+    void caserecpt(uint64_t case_id, account_name proposer, asset vote_yes, asset vote_no, asset key_supply,
+                   asset vote_funding, uint64_t member_count, asset each_contribute, asset actual_funding);
+
     inline asset get_balance(account_name owner, symbol_name sym)const;
 
-    void handleTransfer(const account_name from, const account_name to, const asset& quantity, string memo);
+    void handleTransfer(const account_name from, const account_name to, const asset& quantity, const string& memo);
+
+    void handleError(const onerror& error);
 	
   private:
     ///@abi table
@@ -93,12 +189,58 @@ class hbtcoop: public eosio::contract{
         asset convert_to_exchange( connector& c, asset in );
         asset convert_from_exchange( connector& c, asset in );
         asset convert( asset from, symbol_type to );
+        bool issue_amount( const connector& c, int64_t in, int64_t& issued )const;
+        bool redeem_amount( const connector& c, int64_t in, int64_t& out )const;
 
         EOSLIB_SERIALIZE( keymarket, (supply)(base)(quote) )
     };
 
     eosio::multi_index<N(keymarket), keymarket> keymarket;
 
+    //常用数量的报价，keymarket每次变化后刷新
+    ///@abi table
+    struct ladder
+    {
+        uint64_t     id;
+        asset        quantity;
+        asset        output;
+        int64_t      impact_bp = 0;     //相对现价的偏离，单位万分之一
+
+        uint64_t primary_key()const{return id;}
+        EOSLIB_SERIALIZE(ladder, (id)(quantity)(output)(impact_bp))
+    };
+    eosio::multi_index<N(ladder), ladder> ladder;
+
+    struct price_quote
+    {
+        asset        output;
+        int64_t      impact_bp;
+        bool         quotable = true;   //false时output为0，ladder中记为不可成交
+    };
+    price_quote get_quote(const struct keymarket& market, asset quantity);
+    void refresh_ladder();
+
+#ifdef HBTCOOP_METRICS
+    //每个操作一行，按METRICS_WINDOW滚动，上一窗口的数据保留在last_*中
+    ///@abi table
+    struct metrics
+    {
+        uint64_t     op;
+        time         window_start = 0;
+        uint64_t     calls = 0;
+        uint64_t     work = 0;          //处理的行数等工作量之和
+        uint64_t     max_work = 0;
+        uint64_t     last_calls = 0;
+        uint64_t     last_work = 0;
+
+        uint64_t primary_key()const{return op;}
+        EOSLIB_SERIALIZE(metrics, (op)(window_start)(calls)(work)(max_work)(last_calls)(last_work))
+    };
+    eosio::multi_index<N(metrics), metrics> metrics;
+
+    void record_metric(uint64_t op, uint64_t work);
+#endif
+
     struct asset_entry{
         asset    balance;          
 
@@ -107,10 +249,6 @@ class hbtcoop: public eosio::contract{
         }
     };
 
-    bool has_balance(account_name owner, asset currency);
-    void sub_balance(account_name owner, asset value);
-    void add_balance(account_name owner, asset value, account_name ram_payer);
-
     struct vote_entry{
         uint64_t case_id;  
         uint8_t  agreed;   
@@ -120,6 +258,7 @@ class hbtcoop: public eosio::contract{
         }
     };
 
+    //旧版账户表，格式不变，用于迁移到balances表，gcvotes会清理其中过期的vote_list
     ///@abi table
     struct accounts {
         account_name    account;          
@@ -134,6 +273,66 @@ class hbtcoop: public eosio::contract{
 
     eosio::multi_index<N(accounts), accounts> accounts;
 
+    //scope为账户，每个账户一行
+    ///@abi table
+    struct balances {
+        account_name    account;          
+        time            join_time = 0;    
+        uint64_t        claim_snapshot = 0;   //上次结算时的claim_index
+        int64_t         guarantee_balance = 0;    //CORE_SYMBOL
+        int64_t         key_balance = 0;          //KEY_SYMBOL
+        int64_t         stake_balance = 0;        //STAKE_SYMBOL
+
+        int64_t& balance(symbol_type sym){
+            if(sym.name() == symbol_type(CORE_SYMBOL).name()) return guarantee_balance;
+            if(sym.name() == symbol_type(KEY_SYMBOL).name()) return key_balance;
+            eosio_assert(sym.name() == symbol_type(STAKE_SYMBOL).name(), "unsupported symbol");
+            return stake_balance;
+        }
+        int64_t balance(symbol_type sym)const{
+            return const_cast<balances*>(this)->balance(sym);
+        }
+        bool empty()const{
+            return guarantee_balance == 0 && key_balance == 0 && stake_balance == 0;
+        }
+
+        uint64_t primary_key()const {return account;}
+
+        EOSLIB_SERIALIZE(balances, (account)(join_time)(claim_snapshot)(guarantee_balance)(key_balance)(stake_balance));
+    };
+    typedef eosio::multi_index<N(balances), balances> balances_table;
+
+    //担保账户登记表，用于按加入时间遍历
+    ///@abi table
+    struct registry {
+        account_name    account;
+        time            join_time = 0;
+
+        uint64_t primary_key()const {return account;}
+        uint128_t by_join()const{return ((uint128_t)join_time << 64) | account;}
+
+        EOSLIB_SERIALIZE(registry, (account)(join_time));
+    };
+
+    typedef eosio::multi_index<N(registry), registry,
+        indexed_by<N(byjoin), const_mem_fun<registry, uint128_t, &registry::by_join>>
+    > registry_table;
+    registry_table registry;
+
+    balances_table::const_iterator find_member(balances_table& balances);
+    balances_table::const_iterator migrate_account(balances_table& balances);
+    void sync_registry(account_name owner, time old_join_time, time new_join_time);
+    void erase_member(balances_table& balances, balances_table::const_iterator member_itr);
+    bool has_balance(account_name owner, asset currency);
+    void settle_guarantee(account_name owner);
+    void sub_balance(account_name owner, asset value);
+    void add_balance(account_name owner, asset value, account_name ram_payer);
+    int64_t deposit_balance(account_name owner, int64_t guarantee_amount, int64_t key_amount, uint64_t claim_index);
+    int64_t voting_power(account_name owner);
+    void adjust_power(account_name owner, int64_t delta, account_name ram_payer);
+    int64_t power_at(account_name owner, uint64_t time);
+    void shift_power(account_name owner, int64_t delta);
+
     ///@abi table
     struct global
     {
@@ -146,11 +345,50 @@ class hbtcoop: public eosio::contract{
         uint64_t     guaranteed_accounts;  
         asset        max_claim;       
 
-        auto primary_key()const{return 0;}
+        uint64_t primary_key()const{return 0;}
         EOSLIB_SERIALIZE(global, (ref_rate)(guarantee_rate)(guarantee_pool)(bonus_pool)(cases_num)(applied_cases)(guaranteed_accounts)(max_claim))
     };
-    eosio::multi_index<N(global), global> global;
+    typedef eosio::multi_index<N(global), global> global_table;
+    global_table global;
+
+    //每个担保账户累计应扣的金额，只有一行，升级前的赔付已逐个扣减，行不存在时为0
+    ///@abi table
+    struct claims
+    {
+        uint64_t     id;
+        uint64_t     claim_index = 0;
+
+        uint64_t primary_key()const{return id;}
+        EOSLIB_SERIALIZE(claims, (id)(claim_index))
+    };
+    eosio::multi_index<N(claims), claims> claims;
 
+    uint64_t get_claim_index();
+
+    //global中资金池和担保账户数的增量，按操作账户分散到GLOBAL_SHARDS行，由compact合并回global
+    ///@abi table
+    struct shards
+    {
+        uint64_t     id;
+        int64_t      guarantee_pool = 0;
+        int64_t      bonus_pool = 0;
+        int64_t      guaranteed_accounts = 0;
+
+        uint64_t primary_key()const{return id;}
+        EOSLIB_SERIALIZE(shards, (id)(guarantee_pool)(bonus_pool)(guaranteed_accounts))
+    };
+    eosio::multi_index<N(shards), shards> shards;
+
+    struct pool_totals
+    {
+        int64_t      guarantee_pool;
+        int64_t      bonus_pool;
+        uint64_t     guaranteed_accounts;
+    };
+    pool_totals get_pool_totals(global_table::const_iterator glb);
+    void add_to_shard(account_name actor, int64_t guarantee_delta, int64_t bonus_delta, int64_t accounts_delta);
+
+    //旧版案例表，只用于迁移到proposals表
     ///@abi table
     struct cases
     {
@@ -166,6 +404,141 @@ class hbtcoop: public eosio::contract{
         EOSLIB_SERIALIZE(cases, (case_id)(case_name)(proposer)(required_fund)(start_time)(vote_yes)(vote_no))
     };
     eosio::multi_index<N(cases), cases> cases;
+
+    //gcvotes的遍历位置及累计回收量
+    ///@abi table
+    struct gccursor
+    {
+        uint64_t        id;
+        account_name    next_account = 0;
+        uint64_t        entries = 0;    //累计删除的投票数
+        uint64_t        bytes = 0;      //累计回收的字节数
+
+        uint64_t primary_key()const{return id;}
+        EOSLIB_SERIALIZE(gccursor, (id)(next_account)(entries)(bytes))
+    };
+    eosio::multi_index<N(gccursor), gccursor> gccursor;
+
+    //案例结束后删除
+    ///@abi table
+    struct proposals
+    {
+        uint64_t        case_id;
+        name            case_name;
+        account_name    proposer;
+        int64_t         required_fund = 0;  //CORE_SYMBOL
+        time            start_time = 0;
+        int64_t         vote_yes = 0;       //STAKE_SYMBOL
+        int64_t         vote_no = 0;        //STAKE_SYMBOL
+
+        auto primary_key()const{return case_id;}
+
+        EOSLIB_SERIALIZE(proposals, (case_id)(case_name)(proposer)(required_fund)(start_time)(vote_yes)(vote_no))
+    };
+    typedef eosio::multi_index<N(proposals), proposals> proposals_table;
+    proposals_table proposals;
+
+    //scope为案例id，投票方向存在vote的最低位：vote = weight << 1 | agreed，按uint64定长保存
+    ///@abi table
+    struct ballots
+    {
+        account_name    voter;
+        int64_t         weight = 0;     //案例开始时投票人的投票权
+        uint8_t         agreed = 0;
+
+        uint64_t primary_key()const{return voter;}
+
+        template<typename DataStream>
+        friend DataStream& operator << (DataStream& ds, const ballots& b){
+            eosio_assert(b.weight >= 0, "packed weight must not be negative");
+            return ds << b.voter << (((uint64_t)b.weight << 1) | (b.agreed ? 1 : 0));
+        }
+        template<typename DataStream>
+        friend DataStream& operator >> (DataStream& ds, ballots& b){
+            uint64_t vote;
+            ds >> b.voter >> vote;
+            b.weight = vote >> 1;
+            b.agreed = vote & 1;
+            return ds;
+        }
+    };
+    typedef eosio::multi_index<N(ballots), ballots> ballots_table;
+
+    //投票期结束的案例按截止时间排队，由finalize处理；案例结束后投票未删完的以deadline为0留在队列中
+    ///@abi table
+    struct deadlines
+    {
+        uint64_t        case_id;
+        time            deadline = 0;
+
+        uint64_t  primary_key()const{return case_id;}
+        uint128_t by_deadline()const{return ((uint128_t)deadline << 64) | case_id;}
+        EOSLIB_SERIALIZE(deadlines, (case_id)(deadline))
+    };
+    typedef eosio::multi_index<N(deadlines), deadlines,
+        indexed_by<N(bydeadline), const_mem_fun<deadlines, uint128_t, &deadlines::by_deadline>>
+    > deadlines_table;
+    deadlines_table deadlines;
+
+    proposals_table::const_iterator find_case(uint64_t case_id);
+    proposals_table::const_iterator migrate_case(uint64_t case_id);
+    void cast_vote(account_name account, uint64_t case_id, uint8_t direction);
+    bool vote_needed(uint64_t case_id);
+    bool prune_votes(uint64_t case_id);
+    const char* pay_case(proposals_table::const_iterator case_itr);
+    void close_case(proposals_table::const_iterator case_itr);
+    void enqueue_case(uint64_t case_id, time deadline, account_name ram_payer);
+    void schedule_finalize(uint64_t tag, uint32_t delay, uint8_t attempt);
+
+    //scope为账户，记录每次投票权变化后的值，投票权重取案例开始前的投票权
+    //投票权 = 未委托时自身的质押量 + 被委托的质押量
+    ///@abi table
+    struct stakechk
+    {
+        uint64_t        time;
+        int64_t         stake;
+
+        uint64_t primary_key()const{return time;}
+        EOSLIB_SERIALIZE(stakechk, (time)(stake))
+    };
+    typedef eosio::multi_index<N(stakechk), stakechk> stakechk_table;
+
+    //账户把质押量委托给代理人投票，代理人不能再委托
+    ///@abi table
+    struct delegations
+    {
+        account_name    owner;
+        account_name    proxy;
+
+        uint64_t primary_key()const{return owner;}
+        EOSLIB_SERIALIZE(delegations, (owner)(proxy))
+    };
+    eosio::multi_index<N(delegations), delegations> delegations;
+
+    //代理人收到的委托质押量之和，随委托人的质押变化增量更新
+    ///@abi table
+    struct proxies
+    {
+        account_name    proxy;
+        int64_t         delegated = 0;
+        uint64_t        delegators = 0;
+
+        uint64_t primary_key()const{return proxy;}
+        EOSLIB_SERIALIZE(proxies, (proxy)(delegated)(delegators))
+    };
+    eosio::multi_index<N(proxies), proxies> proxies;
+
+    //批量充值时先记入转账人的额度，由batchdeposit分配给各受益人
+    ///@abi table
+    struct credits
+    {
+        account_name    owner;
+        asset           balance;
+
+        uint64_t primary_key()const{return owner;}
+        EOSLIB_SERIALIZE(credits, (owner)(balance))
+    };
+    eosio::multi_index<N(credits), credits> credits;
 };
 
 extern "C"
@@ -181,9 +554,14 @@ extern "C"
         hbtcoop thiscontract(self);
         if (code == self || action == N(onerror))
         {   // Action is pushed directly to the contract
+            if (action == N(onerror))
+            {   //deferred transaction failed
+                thiscontract.handleError(onerror::from_current_action());
+                return;
+            }
             switch (action)
             {
-                EOSIO_API(medishares, (init)(transfer)(sellkey)(stakekey)(unstakekey)(propose)(approve)(unapprove)(cancelvote)(execproposal)(delproposal))
+                EOSIO_API(hbtcoop, (init)(transfer)(sellkey)(stakekey)(unstakekey)(propose)(approve)(unapprove)(cancelvote)(votebatch)(delegate)(undelegate)(execproposal)(delproposal)(settle)(settlebatch)(migrate)(batchdeposit)(withdrawcredit)(compact)(finalize)(gcvotes)(quote)(setladder)(audit)(caserecpt))
             }
         }
         else if (code == N(eosio.token) && action == N(transfer))
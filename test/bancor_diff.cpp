@@ -0,0 +1,140 @@
+//定点bancor内核的差分测试
+//随机生成(supply, balance, amount)，通过quote动作取合约的报价，分别与旧版double实现和四精度参考值比较
+//用法：bancor_diff [样本数] [随机种子]
+#include "tables.hpp"
+#include <cmath>
+#include <random>
+#include <quadmath.h>
+
+using namespace test;
+
+struct stats {
+    uint64_t samples = 0;
+    uint64_t rejected = 0;        //合约判定越界
+    uint64_t exact = 0;           //与精确值截断后相同
+    uint64_t over = 0;            //大于精确值，不允许出现
+    int64_t  max_under = 0;       //低于精确值截断的最大单位数
+    double   max_relative = 0;    //低于精确值的最大相对误差
+    uint64_t double_mismatch = 0; //旧版double实现与精确值不同
+    int64_t  double_max_diff = 0;
+};
+
+//旧版实现，见baseline的keymarket::convert_to_exchange/convert_from_exchange
+static int64_t double_buy(int64_t supply, int64_t balance, int64_t in){
+    double R(supply), C(balance + in), F(.5 / 1000.0), T(in), ONE(1.0);
+    return int64_t(-R * (ONE - std::pow(ONE + T / C, F)));
+}
+
+static int64_t double_sell(int64_t supply, int64_t balance, int64_t in){
+    double R(supply - in), C(balance), F(1000.0 / .5), E(in), ONE(1.0);
+    return int64_t(C * (std::pow(ONE + E / R, F) - ONE));
+}
+
+//四精度参考值，返回截断前的实数
+static __float128 exact_buy(int64_t supply, int64_t balance, int64_t in){
+    __float128 C = (__float128)(balance + in);
+    return (__float128)supply * expm1q(log1pq((__float128)in / C) * (__float128)0.0005Q);
+}
+
+static __float128 exact_sell(int64_t supply, int64_t balance, int64_t in){
+    __float128 R = (__float128)(supply - in);
+    return (__float128)balance * expm1q(log1pq((__float128)in / R) * (__float128)2000);
+}
+
+static bool run_quote(tester& t, const asset& quantity, int64_t& output){
+    auto r = t.push_action(N(alice), N(quote), quantity);
+    if(!r.ok){
+        REQUIRE(r.error == "conversion out of range" || r.error == "magnitude of asset amount must be less than 2^62");
+        return false;
+    }
+    long long in = 0, out = 0, impact = 0;
+    REQUIRE(std::sscanf(r.console.c_str(), "quote %lld -> %lld, price impact %lld bp", &in, &out, &impact) == 3);
+    output = out;
+    return true;
+}
+
+static void record(stats& s, int64_t fixed, __float128 exact, int64_t old){
+    __float128 floor_exact = floorq(exact);
+    int64_t expected = (int64_t)floor_exact;
+    //精确值非常接近整数时截断结果不确定，跳过
+    if(exact - floor_exact < 1e-9Q || floor_exact + 1 - exact < 1e-9Q){
+        return;
+    }
+    s.samples++;
+    if(fixed == expected){
+        s.exact++;
+    }else if(fixed > expected){
+        s.over++;
+    }else{
+        if(expected - fixed > s.max_under) s.max_under = expected - fixed;
+        double relative = (double)(expected - fixed) / (double)expected;
+        if(relative > s.max_relative) s.max_relative = relative;
+    }
+    if(old != expected){
+        s.double_mismatch++;
+        int64_t diff = old > expected ? old - expected : expected - old;
+        if(diff > s.double_max_diff) s.double_max_diff = diff;
+    }
+}
+
+static void report(const char* name, const stats& s){
+    std::printf("%-10s samples %9llu  rejected %7llu  exact %9llu  over %llu  max_under %lld (%.1e)  double_mismatch %llu (max %lld)\n",
+                name, (unsigned long long)s.samples, (unsigned long long)s.rejected, (unsigned long long)s.exact,
+                (unsigned long long)s.over, (long long)s.max_under, s.max_relative,
+                (unsigned long long)s.double_mismatch, (long long)s.double_max_diff);
+}
+
+int main(int argc, char** argv){
+    uint64_t samples = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+    uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+
+    tester t;
+    t.create_account(N(alice));
+    std::mt19937_64 rng(seed);
+    //对数均匀分布，覆盖从最小单位到1e15的各个量级
+    auto log_uniform = [&](int64_t lo, int64_t hi){
+        std::uniform_real_distribution<double> d(std::log((double)lo), std::log((double)hi));
+        int64_t v = (int64_t)std::exp(d(rng));
+        return std::min(std::max(v, lo), hi);
+    };
+
+    stats buys, sells, large_sells;
+    for(uint64_t i = 0; i < samples; i++){
+        int64_t supply = log_uniform(1000000, 1000000000000000LL);
+        int64_t balance = log_uniform(1000, 1000000000000000LL);
+        t.set_row(N(keymarket), tester::code, S(0,KEY), keymarket_row{
+            key(supply), key(supply), .5, eos(balance), .5
+        });
+
+        int64_t fixed = 0;
+        if(i % 2 == 0){
+            int64_t in = log_uniform(1, 1000000000000000LL);
+            if(!run_quote(t, eos(in), fixed)){
+                buys.rejected++;
+                continue;
+            }
+            record(buys, fixed, exact_buy(supply, balance, in), double_buy(supply, balance, in));
+        }else{
+            int64_t in = log_uniform(1, supply - 1);
+            __float128 exact = exact_sell(supply, balance, in);
+            //卖出所得超过连接器余额的报价在合约里不可能成交，单独统计
+            stats& s = exact <= (__float128)balance ? sells : large_sells;
+            if(!run_quote(t, key(in), fixed)){
+                s.rejected++;
+                REQUIRE(exact >= (__float128)asset::max_amount);
+                continue;
+            }
+            record(s, fixed, exact, exact < 9e18Q ? double_sell(supply, balance, in) : 0);
+        }
+    }
+
+    report("buy", buys);
+    report("sell", sells);
+    report("large sell", large_sells);
+
+    //定点结果只能向下取整，不能多付；可成交的报价最多少1个单位，超大卖单按相对误差衡量
+    REQUIRE(buys.over == 0 && sells.over == 0 && large_sells.over == 0);
+    REQUIRE(buys.max_under <= 1 && sells.max_under <= 1);
+    REQUIRE(large_sells.max_relative <= 1e-11);
+    return 0;
+}
@@ -0,0 +1,191 @@
+//各动作随会员数增长的开销测试，以及会员和案例占用的RAM，结果以JSON输出，便于比较不同版本
+//用法：bench [--sizes 1000,10000,...] [--runs N] [--out file]
+#include "tables.hpp"
+#include <chrono>
+#include <string>
+
+using namespace test;
+
+static const uint32_t day = 24 * 3600;
+
+struct measurement {
+    std::string action;
+    uint64_t    runs = 0;
+    uint64_t    wall_ns = 0;
+    uint64_t    db_reads = 0;
+    uint64_t    db_writes = 0;
+    uint64_t    bytes_read = 0;
+    uint64_t    bytes_written = 0;
+    int64_t     ram_delta = 0;
+};
+
+static int64_t total_ram(tester& t){
+    int64_t total = 0;
+    for(const auto& r : t.chain().ram_usage) total += r.second;
+    return total;
+}
+
+//合约表按nodeos的计费大小统计：会员相关的表按会员数平均，案例相关的表按案例数平均
+struct footprint {
+    uint64_t members = 0;
+    int64_t  member_bytes = 0;
+    uint64_t cases = 0;
+    int64_t  case_bytes = 0;
+};
+
+static footprint ram_footprint(tester& t){
+    footprint f;
+    for(const auto& tbl : t.chain().db){
+        if(tbl.first.code != tester::code) continue;
+        int64_t bytes = 0;
+        for(const auto& r : tbl.second.rows) bytes += eosio::host::billable_size(r.second);
+        auto table = tbl.first.table;
+        if(table == N(balances)) f.members += tbl.second.rows.size();
+        if(table == N(proposals)) f.cases += tbl.second.rows.size();
+        if(table == N(balances) || table == N(registry) || table == N(stakechk) || table == N(delegations) || table == N(proxies)){
+            f.member_bytes += bytes;
+        }else if(table == N(proposals) || table == N(ballots) || table == N(deadlines)){
+            f.case_bytes += bytes;
+        }
+    }
+    return f;
+}
+
+//执行runs次，统计平均值；每次调用都必须成功
+template<typename F>
+static measurement measure(tester& t, const char* name, uint64_t runs, F&& call){
+    measurement m;
+    m.action = name;
+    m.runs = runs;
+    for(uint64_t i = 0; i < runs; i++){
+        auto before = t.chain().stats;
+        int64_t ram = total_ram(t);
+        auto start = std::chrono::steady_clock::now();
+        auto r = call(i);
+        auto stop = std::chrono::steady_clock::now();
+        if(!r.ok){
+            std::fprintf(stderr, "%s #%llu failed: %s\n", name, (unsigned long long)i, r.error.c_str());
+            std::exit(1);
+        }
+        const auto& after = t.chain().stats;
+        m.wall_ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+        m.db_reads += after.db_reads - before.db_reads;
+        m.db_writes += after.db_writes - before.db_writes;
+        m.bytes_read += after.bytes_read - before.bytes_read;
+        m.bytes_written += after.bytes_written - before.bytes_written;
+        m.ram_delta += total_ram(t) - ram;
+    }
+    return m;
+}
+
+static std::vector<measurement> run_size(uint64_t accounts, uint64_t runs, footprint& ram){
+    tester t;
+    REQUIRE_OK(t.push_action(tester::code, N(init), (uint64_t)300, (uint64_t)100, eos(100000 * 10000)));
+
+    //前runs个会员有少量质押，用于测质押；w持有绝大部分质押（超过2^32，选票按uint64定长存储），赞成所有提案使其通过；其余会员只有担保金和KEY
+    seed_members(t, 'v', runs, 30000, 60000, 1000, 500);
+    seed_members(t, 'w', 1, 30000, 60000, 10000000000LL, 10000000000LL);
+    seed_members(t, 'm', accounts - runs - 1, 30000, 60000, 1000, 0);
+    REQUIRE_OK(t.push_action(tester::code, N(audit)));
+    t.produce(181 * day);
+
+    std::vector<measurement> out;
+    out.push_back(measure(t, "handleTransfer", runs, [&](uint64_t i){
+        account_name a = account_for('n', i);
+        t.create_account(a);
+        t.issue(a, 1000 * 10000);
+        return t.transfer(a, tester::code, eos(10 * 10000));
+    }));
+    out.push_back(measure(t, "stakekey", runs, [&](uint64_t i){
+        account_name a = account_for('v', i);
+        return t.push_action(a, N(stakekey), a, key(1));
+    }));
+    out.push_back(measure(t, "unstakekey", runs, [&](uint64_t i){
+        account_name a = account_for('v', i);
+        return t.push_action(a, N(unstakekey), a, asset(1, S(0,STKEY)));
+    }));
+
+    //每个提案由一个会员提出，合计最多申请一半担保金
+    uint64_t proposals = runs;
+    int64_t required = (int64_t)(accounts * 30000 / (2 * proposals));
+    for(uint64_t i = 0; i < proposals; i++){
+        account_name a = account_for('m', i);
+        REQUIRE_OK(t.push_action(a, N(propose), a, eosio::name{N(bench)}, eos(required)));
+    }
+    t.produce(day);
+    out.push_back(measure(t, "approve", proposals, [&](uint64_t i){
+        account_name a = account_for('w', 0);
+        return t.push_action(a, N(approve), a, (uint64_t)(i + 1));
+    }));
+    //所有会员和案例都在、每个案例有一张选票时统计RAM
+    ram = ram_footprint(t);
+
+    t.produce(30 * day);
+    out.push_back(measure(t, "execproposal", proposals, [&](uint64_t i){
+        account_name a = account_for('m', i);
+        return t.push_action(a, N(execproposal), a, (uint64_t)(i + 1));
+    }));
+
+    //赔付后老会员再次充值，结算欠款与充值在同一次写入中完成
+    out.push_back(measure(t, "handleTransfer.member", runs, [&](uint64_t i){
+        account_name a = account_for('m', i);
+        t.issue(a, 10 * 10000);
+        return t.transfer(a, tester::code, eos(10 * 10000));
+    }));
+    return out;
+}
+
+static std::vector<uint64_t> parse_sizes(const char* s){
+    std::vector<uint64_t> sizes;
+    while(*s){
+        char* end = nullptr;
+        sizes.push_back(std::strtoull(s, &end, 10));
+        s = *end == ',' ? end + 1 : end;
+    }
+    return sizes;
+}
+
+int main(int argc, char** argv){
+    std::vector<uint64_t> sizes = {1000, 10000, 100000, 1000000};
+    uint64_t runs = 100;
+    const char* out_path = nullptr;
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string arg = argv[i];
+        if(arg == "--sizes") sizes = parse_sizes(argv[i + 1]);
+        else if(arg == "--runs") runs = std::strtoull(argv[i + 1], nullptr, 10);
+        else if(arg == "--out") out_path = argv[i + 1];
+    }
+    REQUIRE(runs > 0);
+
+    FILE* out = out_path ? std::fopen(out_path, "w") : stdout;
+    REQUIRE(out != nullptr);
+    std::fprintf(out, "{\"contract\": \"hbtcoop\", \"runs\": %llu, \"results\": [", (unsigned long long)runs);
+    bool first = true;
+    std::vector<std::pair<uint64_t, footprint>> footprints;
+    for(auto accounts : sizes){
+        REQUIRE(accounts > 2 * runs);
+        footprint ram;
+        for(const auto& m : run_size(accounts, runs, ram)){
+            std::fprintf(out, "%s\n  {\"accounts\": %llu, \"action\": \"%s\", \"wall_ns\": %llu, \"db_reads\": %.1f, \"db_writes\": %.1f, "
+                              "\"bytes_read\": %.1f, \"bytes_written\": %.1f, \"ram_delta\": %.1f}",
+                         first ? "" : ",", (unsigned long long)accounts, m.action.c_str(), (unsigned long long)(m.wall_ns / m.runs),
+                         (double)m.db_reads / m.runs, (double)m.db_writes / m.runs,
+                         (double)m.bytes_read / m.runs, (double)m.bytes_written / m.runs, (double)m.ram_delta / m.runs);
+            first = false;
+        }
+        footprints.emplace_back(accounts, ram);
+        std::fflush(out);
+    }
+    std::fprintf(out, "\n], \"ram\": [");
+    first = true;
+    for(const auto& f : footprints){
+        std::fprintf(out, "%s\n  {\"accounts\": %llu, \"members\": %llu, \"bytes_per_member\": %.1f, \"cases\": %llu, \"bytes_per_case\": %.1f}",
+                     first ? "" : ",", (unsigned long long)f.first,
+                     (unsigned long long)f.second.members, (double)f.second.member_bytes / f.second.members,
+                     (unsigned long long)f.second.cases, (double)f.second.case_bytes / f.second.cases);
+        first = false;
+    }
+    std::fprintf(out, "\n]}\n");
+    if(out != stdout) std::fclose(out);
+    return 0;
+}
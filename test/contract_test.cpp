@@ -0,0 +1,293 @@
+//合约主要流程的宿主机测试
+#include "tables.hpp"
+#include <cmath>
+#include <cstdlib>
+
+using namespace test;
+
+static const account_name alice = N(alice);
+static const account_name bob = N(bob);
+static const account_name carol = N(carol);
+
+static const uint32_t day = 24 * 3600;
+
+static void setup(tester& t){
+    for(auto a : {alice, bob, carol}){
+        t.create_account(a);
+        t.issue(a, 10000 * 10000);
+    }
+    REQUIRE_OK(t.push_action(tester::code, N(init), (uint64_t)300, (uint64_t)100, eos(1000 * 10000)));
+}
+
+static void test_deposit_and_sell(){
+    tester t;
+    setup(t);
+
+    REQUIRE_OK(t.transfer(alice, tester::code, eos(100 * 10000)));
+    REQUIRE(t.balance(tester::code) == 100 * 10000);
+
+    auto row = get_balance(t, alice);
+    REQUIRE(row.join_time == t.now());
+    REQUIRE(row.guarantee_balance > 0);
+    REQUIRE(row.key_balance > 0);
+    REQUIRE_OK(t.push_action(alice, N(audit)));
+
+    //卖出全部KEY，取回的EOS不超过投入的奖金部分
+    int64_t before = t.balance(alice);
+    REQUIRE_OK(t.push_action(alice, N(sellkey), alice, key(row.key_balance)));
+    int64_t proceeds = t.balance(alice) - before;
+    REQUIRE(proceeds > 0);
+    REQUIRE(proceeds < 100 * 10000 - row.guarantee_balance);
+    REQUIRE(get_balance(t, alice).key_balance == 0);
+    REQUIRE_OK(t.push_action(alice, N(audit)));
+}
+
+static void test_failed_action_rolls_back(){
+    tester t;
+    setup(t);
+    REQUIRE_OK(t.transfer(alice, tester::code, eos(100 * 10000)));
+
+    auto row = get_balance(t, alice);
+    int64_t ram = t.chain().ram_usage[tester::code];
+    REQUIRE_ERROR(t.push_action(alice, N(sellkey), alice, key(row.key_balance + 1)), "");
+    REQUIRE_ERROR(t.push_action(bob, N(sellkey), alice, key(1)), "missing authority of alice");
+    REQUIRE_ERROR(t.transfer(alice, tester::code, eos(1)), "must greater than 0.1 EOS");
+
+    auto after = get_balance(t, alice);
+    REQUIRE(after.key_balance == row.key_balance);
+    REQUIRE(t.chain().ram_usage[tester::code] == ram);
+    REQUIRE(t.balance(tester::code) == 100 * 10000);
+}
+
+static void test_case_payout(){
+    tester t;
+    setup(t);
+    for(auto a : {alice, bob, carol}){
+        REQUIRE_OK(t.transfer(a, tester::code, eos(100 * 10000)));
+    }
+    REQUIRE_OK(t.push_action(bob, N(stakekey), bob, key(get_balance(t, bob).key_balance)));
+
+    t.produce(181 * day);
+    REQUIRE_OK(t.push_action(alice, N(propose), alice, eosio::name{N(broken.leg)}, eos(10 * 10000)));
+    t.produce(day);
+    REQUIRE_OK(t.push_action(bob, N(approve), bob, (uint64_t)1));
+    REQUIRE(t.row_count(N(proposals), tester::code) == 1);
+    REQUIRE(t.row_count(N(ballots), 1) == 1);
+    REQUIRE_ERROR(t.push_action(alice, N(execproposal), alice, (uint64_t)1), "voting has not been completed");
+
+    //投票期结束后由延迟交易自动赔付
+    int64_t before = t.balance(alice);
+    t.produce(30 * day);
+    REQUIRE(t.run_deferred() >= 1);
+    REQUIRE(t.deferred_errors.empty());
+    REQUIRE(t.balance(alice) > before);
+
+    bool notified = false;
+    for(const auto& tr : t.traces){
+        if(tr.receiver == alice && tr.account == tester::code && tr.name == N(caserecpt)) notified = true;
+    }
+    REQUIRE(notified);
+    REQUIRE(t.row_count(N(proposals), tester::code) == 0);
+    REQUIRE(t.row_count(N(ballots), 1) == 0);
+    REQUIRE_OK(t.push_action(alice, N(audit)));
+}
+
+//超出兑换范围的报价点记为0，不影响充值和卖出
+static void test_unquotable_ladder_point(){
+    tester t;
+    setup(t);
+    REQUIRE_OK(t.push_action(tester::code, N(setladder), std::vector<asset>{eos(10 * 10000), key(1000000)}));
+    REQUIRE_ERROR(t.push_action(alice, N(quote), key(1000000)), "conversion out of range");
+
+    REQUIRE_OK(t.transfer(alice, tester::code, eos(100 * 10000)));
+    REQUIRE_OK(t.push_action(alice, N(sellkey), alice, key(get_balance(t, alice).key_balance / 2)));
+    ladder_row point;
+    REQUIRE(t.get_row(N(ladder), tester::code, 0, point));
+    REQUIRE(point.output.amount > 0);
+    //按同一条曲线用double复算：现价 = reserve / (supply * f)，成交价 = 花费 / 得到的KEY
+    keymarket_row km;
+    REQUIRE(t.get_row(N(keymarket), tester::code, S(0,KEY), km));
+    double in = 10 * 10000, reserve = km.quote_balance.amount, supply = km.supply.amount, f = km.quote_weight / 1000;
+    double out = supply * (std::pow(1 + in / (reserve + in), f) - 1);
+    REQUIRE(std::fabs(point.output.amount - out) <= 1);
+    double expected = (in / point.output.amount) / (reserve / (supply * f)) - 1;
+    REQUIRE(point.impact_bp > 0 && point.impact_bp < 2000);
+    REQUIRE(std::llabs(point.impact_bp - (int64_t)(expected * 10000)) <= 1);
+    REQUIRE(t.get_row(N(ladder), tester::code, 1, point));
+    REQUIRE(point.output.amount == 0 && point.impact_bp == 10000);
+}
+
+//队首的案例总是赔付失败时，重试用完后移出队列，不再阻塞后面的案例
+static void test_failing_head_is_dropped(){
+    tester t;
+    setup(t);
+    for(auto a : {alice, bob, carol}){
+        REQUIRE_OK(t.transfer(a, tester::code, eos(100 * 10000)));
+    }
+    for(auto a : {bob, carol}){
+        REQUIRE_OK(t.push_action(a, N(stakekey), a, key(get_balance(t, a).key_balance)));
+    }
+    t.produce(181 * day);
+    REQUIRE_OK(t.push_action(alice, N(propose), alice, eosio::name{N(broken.leg)}, eos(10 * 10000)));
+    t.produce(1);
+    REQUIRE_OK(t.push_action(carol, N(propose), carol, eosio::name{N(broken.arm)}, eos(10 * 10000)));
+    t.produce(day);
+    REQUIRE_OK(t.push_action(bob, N(approve), bob, (uint64_t)1));
+    REQUIRE_OK(t.push_action(carol, N(unapprove), carol, (uint64_t)2));
+
+    //合约的EOS被转走，案例1的赔付转账失败
+    int64_t funds = t.balance(tester::code);
+    t.tokens[tester::code] = 0;
+    t.produce(30 * day);
+    for(int i = 0; i <= 5; i++){
+        t.run_deferred();
+        t.produce(3600);
+    }
+    REQUIRE(!t.deferred_errors.empty());
+    REQUIRE(t.deferred_errors[0].find("overdrawn balance") != std::string::npos);
+    REQUIRE(t.row_count(N(deadlines), tester::code) == 0);
+    REQUIRE(t.row_count(N(proposals), tester::code) == 1);
+    REQUIRE(t.chain().deferred.empty());
+
+    //资金恢复后提案人仍可以自行领取
+    t.tokens[tester::code] = funds;
+    int64_t before = t.balance(alice);
+    REQUIRE_OK(t.push_action(alice, N(execproposal), alice, (uint64_t)1));
+    REQUIRE(t.balance(alice) > before);
+    REQUIRE(t.row_count(N(proposals), tester::code) == 0);
+}
+
+//批量转账的额度未分配时可以由转账人取回
+static void test_withdraw_credit(){
+    tester t;
+    setup(t);
+    int64_t before = t.balance(alice);
+    REQUIRE_OK(t.transfer(alice, tester::code, eos(50 * 10000), "\"batch\""));
+    REQUIRE_OK(t.push_action(alice, N(batchdeposit), alice, std::vector<deposit_arg>{{bob, eos(20 * 10000)}}));
+    REQUIRE_ERROR(t.push_action(bob, N(withdrawcredit), alice), "missing authority of alice");
+    REQUIRE_OK(t.push_action(alice, N(withdrawcredit), alice));
+    REQUIRE(t.balance(alice) == before - 20 * 10000);
+    REQUIRE(t.row_count(N(credits), tester::code) == 0);
+    REQUIRE_ERROR(t.push_action(alice, N(withdrawcredit), alice), "no batch transfer found");
+    REQUIRE_OK(t.push_action(alice, N(audit)));
+}
+
+//单笔或累计超出额度的批量存款必须被拒绝，不能靠int64溢出绕过额度检查
+static void test_batchdeposit_overflow(){
+    tester t;
+    setup(t);
+    t.issue(alice, 20000 * 10000);
+    REQUIRE_OK(t.transfer(alice, tester::code, eos(20000 * 10000), "\"batch\""));
+    std::vector<deposit_arg> deposits;
+    for(int i = 0; i < 12; i++){
+        account_name a = eosio::string_to_name((std::string("whale") + char('a' + i)).c_str());
+        t.create_account(a);
+        deposits.push_back({a, eos(eosio::asset::max_amount)});
+    }
+    deposits.push_back({bob, eos(10 * 10000)});
+    REQUIRE_ERROR(t.push_action(alice, N(batchdeposit), alice, deposits), "deposits exceed the transferred amount");
+    REQUIRE_ERROR(t.push_action(alice, N(batchdeposit), alice, std::vector<deposit_arg>{{bob, eos(10000 * 10000)}, {carol, eos(10000 * 10000)}, {carol, eos(10 * 10000)}}), "duplicate beneficiary in deposit list");
+    REQUIRE_ERROR(t.push_action(alice, N(batchdeposit), alice, std::vector<deposit_arg>{{bob, eos(10000 * 10000)}, {carol, eos(10000 * 10000 + 1)}}), "deposits exceed the transferred amount");
+    REQUIRE_OK(t.push_action(alice, N(batchdeposit), alice, std::vector<deposit_arg>{{bob, eos(10000 * 10000)}, {carol, eos(10000 * 10000)}}));
+    REQUIRE(t.row_count(N(credits), tester::code) == 0);
+    REQUIRE_OK(t.push_action(alice, N(audit)));
+}
+
+//旧版accounts表的账户在首次访问时迁移，从claim_index为0开始结算，升级后的赔付照常分摊
+static void test_legacy_account_migration(){
+    tester t;
+    setup(t);
+    const account_name dave = N(dave);
+    const int64_t guarantee = 30 * 10000;
+    t.create_account(dave);
+    t.set_row(N(accounts), tester::code, dave, legacy_account_row{dave, t.now(), {eos(guarantee)}, {}});
+    global_row gl;
+    REQUIRE(t.get_row(N(global), tester::code, 0, gl));
+    gl.guarantee_pool.amount += guarantee;
+    gl.guaranteed_accounts += 1;
+    t.set_row(N(global), tester::code, 0, gl);
+    t.issue(tester::code, guarantee);
+
+    for(auto a : {alice, bob}){
+        REQUIRE_OK(t.transfer(a, tester::code, eos(100 * 10000)));
+    }
+    REQUIRE_OK(t.push_action(bob, N(stakekey), bob, key(get_balance(t, bob).key_balance)));
+    t.produce(181 * day);
+    REQUIRE_OK(t.push_action(alice, N(propose), alice, eosio::name{N(broken.leg)}, eos(10 * 10000)));
+    t.produce(day);
+    REQUIRE_OK(t.push_action(bob, N(approve), bob, (uint64_t)1));
+    t.produce(30 * day);
+    REQUIRE_OK(t.push_action(alice, N(execproposal), alice, (uint64_t)1));
+    uint64_t index = claim_index(t);
+    REQUIRE(index > 0);
+    REQUIRE(t.row_count(N(accounts), tester::code) == 1);
+
+    REQUIRE_OK(t.push_action(dave, N(settle), dave));
+    auto row = get_balance(t, dave);
+    REQUIRE(row.claim_snapshot == index);
+    REQUIRE(row.guarantee_balance == guarantee - (int64_t)index);
+    REQUIRE(t.row_count(N(accounts), tester::code) == 0);
+    REQUIRE_OK(t.push_action(alice, N(audit)));
+}
+
+//旧版账户的vote_list在首次投票操作时迁移成ballots，之后撤票和改票按迁移后的选票计算
+static void test_legacy_voter(){
+    const account_name dave = N(dave);
+    const int64_t stake = 50 * 10000;
+    for(auto first : {N(cancelvote), N(approve), N(unapprove)}){
+        tester t;
+        setup(t);
+        for(auto a : {alice, bob}){
+            REQUIRE_OK(t.transfer(a, tester::code, eos(100 * 10000)));
+        }
+        REQUIRE_OK(t.push_action(bob, N(stakekey), bob, key(get_balance(t, bob).key_balance)));
+        t.produce(181 * day);
+        REQUIRE_OK(t.push_action(alice, N(propose), alice, eosio::name{N(broken.leg)}, eos(10 * 10000)));
+        t.produce(day);
+
+        //升级前dave已投赞成票，proposals中的计票已包含他的质押
+        t.create_account(dave);
+        t.set_row(N(accounts), tester::code, dave, legacy_account_row{dave, 1, {asset(stake, S(0,STKEY))}, {{1, 1}}});
+        proposal_row p;
+        REQUIRE(t.get_row(N(proposals), tester::code, 1, p));
+        p.vote_yes += stake;
+        t.set_row(N(proposals), tester::code, 1, p);
+
+        if(first == N(approve)){
+            //迁移出的选票已是赞成票，重复赞成被拒绝，整个action回滚
+            REQUIRE_ERROR(t.push_action(dave, first, dave, (uint64_t)1), "agreeded before");
+            REQUIRE(t.row_count(N(accounts), tester::code) == 1);
+            REQUIRE_OK(t.push_action(dave, N(unapprove), dave, (uint64_t)1));
+        }else{
+            REQUIRE_OK(t.push_action(dave, first, dave, (uint64_t)1));
+        }
+        REQUIRE(t.row_count(N(accounts), tester::code) == 0);
+        REQUIRE(t.get_row(N(proposals), tester::code, 1, p));
+        if(first == N(cancelvote)){
+            REQUIRE(p.vote_yes == 0 && p.vote_no == 0);
+            REQUIRE_OK(t.push_action(dave, N(approve), dave, (uint64_t)1));
+            REQUIRE(t.get_row(N(proposals), tester::code, 1, p));
+            REQUIRE(p.vote_yes == stake && p.vote_no == 0);
+        }else{
+            REQUIRE(p.vote_yes == 0 && p.vote_no == stake);
+            REQUIRE_OK(t.push_action(dave, N(cancelvote), dave, (uint64_t)1));
+            REQUIRE(t.get_row(N(proposals), tester::code, 1, p));
+            REQUIRE(p.vote_yes == 0 && p.vote_no == 0);
+        }
+        REQUIRE_OK(t.push_action(alice, N(audit)));
+    }
+}
+
+int main(){
+    test_deposit_and_sell();
+    test_failed_action_rolls_back();
+    test_case_payout();
+    test_unquotable_ladder_point();
+    test_failing_head_is_dropped();
+    test_withdraw_credit();
+    test_batchdeposit_overflow();
+    test_legacy_account_migration();
+    test_legacy_voter();
+    std::printf("contract_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <eosiolib/datastream.hpp>
+
+namespace eosio {
+
+    struct permission_level {
+        permission_level(account_name a, permission_name p) : actor(a), permission(p) {}
+        permission_level() : actor(0), permission(0) {}
+
+        account_name    actor;
+        permission_name permission;
+
+        friend bool operator==(const permission_level& a, const permission_level& b){
+            return a.actor == b.actor && a.permission == b.permission;
+        }
+
+        EOSLIB_SERIALIZE(permission_level, (actor)(permission))
+    };
+
+    struct action {
+        account_name                  account = 0;
+        action_name                   name = 0;
+        std::vector<permission_level> authorization;
+        std::vector<char>             data;
+
+        action() = default;
+
+        template<typename T>
+        action(const permission_level& auth, account_name a, action_name n, T&& value)
+            : account(a), name(n), authorization(1, auth), data(pack(std::forward<T>(value))) {}
+
+        template<typename T>
+        action(std::vector<permission_level> auths, account_name a, action_name n, T&& value)
+            : account(a), name(n), authorization(std::move(auths)), data(pack(std::forward<T>(value))) {}
+
+        //内联发送，定义在chain.hpp
+        void send()const;
+
+        template<typename T>
+        T data_as()const { return unpack<T>(data); }
+
+        EOSLIB_SERIALIZE(action, (account)(name)(authorization)(data))
+    };
+
+    template<typename T>
+    T unpack_action_data();
+
+}
+
+#include <eosiolib/chain.hpp>
@@ -0,0 +1,169 @@
+#pragma once
+#include <eosiolib/datastream.hpp>
+#include <limits>
+
+namespace eosio {
+
+    static constexpr uint64_t string_to_symbol(uint8_t precision, const char* str){
+        uint32_t len = 0;
+        while(str[len]) ++len;
+
+        uint64_t result = 0;
+        for(uint32_t i = 0; i < len; ++i){
+            if(str[i] < 'A' || str[i] > 'Z'){
+                //与eosiolib一致：非法字符不在编译期报错
+            }else{
+                result |= (uint64_t(str[i]) << (8 * (1 + i)));
+            }
+        }
+        result |= uint64_t(precision);
+        return result;
+    }
+
+    static constexpr bool is_valid_symbol(symbol_name sym){
+        sym >>= 8;
+        for(int i = 0; i < 7; ++i){
+            char c = (char)(sym & 0xff);
+            if(!('A' <= c && c <= 'Z')) return false;
+            sym >>= 8;
+            if(!(sym & 0xff)){
+                do{
+                    sym >>= 8;
+                    if((sym & 0xff)) return false;
+                    ++i;
+                }while(i < 7);
+            }
+        }
+        return true;
+    }
+
+    struct symbol_type {
+        constexpr symbol_type(symbol_name s = 0) : value(s) {}
+
+        bool is_valid()const { return is_valid_symbol(value); }
+        uint64_t precision()const { return value & 0xff; }
+        uint64_t name()const { return value >> 8; }
+        operator symbol_name()const { return value; }
+
+        symbol_name value;
+
+        template<typename DataStream>
+        friend DataStream& operator<<(DataStream& ds, const symbol_type& s){ return ds << s.value; }
+        template<typename DataStream>
+        friend DataStream& operator>>(DataStream& ds, symbol_type& s){ return ds >> s.value; }
+    };
+
+}
+
+#define S(P,X) ::eosio::string_to_symbol(P,#X)
+
+#ifndef CORE_SYMBOL
+#define CORE_SYMBOL S(4,EOS)
+#endif
+
+namespace eosio {
+
+    struct asset {
+        int64_t amount;
+        symbol_type symbol;
+
+        static constexpr int64_t max_amount = (1LL << 62) - 1;
+
+        explicit asset(int64_t a = 0, symbol_type s = CORE_SYMBOL) : amount(a), symbol{s} {
+            eosio_assert(is_amount_within_range(), "magnitude of asset amount must be less than 2^62");
+            eosio_assert(symbol.is_valid(), "invalid symbol name");
+        }
+
+        bool is_amount_within_range()const { return -max_amount <= amount && amount <= max_amount; }
+        bool is_valid()const { return is_amount_within_range() && symbol.is_valid(); }
+
+        asset operator-()const {
+            asset r = *this;
+            r.amount = -r.amount;
+            return r;
+        }
+
+        asset& operator-=(const asset& a){
+            eosio_assert(a.symbol == symbol, "attempt to subtract asset with different symbol");
+            amount -= a.amount;
+            eosio_assert(-max_amount <= amount, "subtraction underflow");
+            eosio_assert(amount <= max_amount, "subtraction overflow");
+            return *this;
+        }
+
+        asset& operator+=(const asset& a){
+            eosio_assert(a.symbol == symbol, "attempt to add asset with different symbol");
+            amount += a.amount;
+            eosio_assert(-max_amount <= amount, "addition underflow");
+            eosio_assert(amount <= max_amount, "addition overflow");
+            return *this;
+        }
+
+        inline friend asset operator+(const asset& a, const asset& b){
+            asset result = a;
+            result += b;
+            return result;
+        }
+
+        inline friend asset operator-(const asset& a, const asset& b){
+            asset result = a;
+            result -= b;
+            return result;
+        }
+
+        asset& operator*=(int64_t a){
+            eosio_assert(a == 0 || (amount * a) / a == amount, "multiplication overflow or underflow");
+            eosio_assert(-max_amount <= amount * a, "multiplication underflow");
+            eosio_assert(amount * a <= max_amount, "multiplication overflow");
+            amount *= a;
+            return *this;
+        }
+
+        friend asset operator*(const asset& a, int64_t b){
+            asset result = a;
+            result *= b;
+            return result;
+        }
+
+        friend asset operator*(int64_t b, const asset& a){
+            asset result = a;
+            result *= b;
+            return result;
+        }
+
+        asset& operator/=(int64_t a){
+            eosio_assert(a != 0, "divide by zero");
+            eosio_assert(!(amount == std::numeric_limits<int64_t>::min() && a == -1), "signed division overflow");
+            amount /= a;
+            return *this;
+        }
+
+        friend asset operator/(const asset& a, int64_t b){
+            asset result = a;
+            result /= b;
+            return result;
+        }
+
+        friend int64_t operator/(const asset& a, const asset& b){
+            eosio_assert(b.amount != 0, "divide by zero");
+            eosio_assert(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+            return a.amount / b.amount;
+        }
+
+        friend bool operator==(const asset& a, const asset& b){
+            eosio_assert(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+            return a.amount == b.amount;
+        }
+        friend bool operator!=(const asset& a, const asset& b){ return !(a == b); }
+        friend bool operator<(const asset& a, const asset& b){
+            eosio_assert(a.symbol == b.symbol, "comparison of assets with different symbols is not allowed");
+            return a.amount < b.amount;
+        }
+        friend bool operator<=(const asset& a, const asset& b){ return !(b < a); }
+        friend bool operator>(const asset& a, const asset& b){ return b < a; }
+        friend bool operator>=(const asset& a, const asset& b){ return !(a < b); }
+
+        EOSLIB_SERIALIZE(asset, (amount)(symbol))
+    };
+
+}
@@ -0,0 +1,229 @@
+#pragma once
+//宿主机上的链状态：数据库、授权、通知、内联/延迟交易和RAM计费
+//每个线程一份，便于并行跑多个随机种子
+#include <eosiolib/action.hpp>
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+#include <tuple>
+
+namespace eosio { namespace host {
+
+    struct table_id {
+        uint64_t code;
+        uint64_t scope;
+        uint64_t table;
+
+        friend bool operator<(const table_id& a, const table_id& b){
+            return std::tie(a.code, a.scope, a.table) < std::tie(b.code, b.scope, b.table);
+        }
+    };
+
+    struct row {
+        std::vector<char>      data;
+        account_name           payer = 0;
+        std::vector<uint128_t> secondary;
+    };
+
+    struct table {
+        std::map<uint64_t, row>                              rows;
+        std::vector<std::set<std::pair<uint128_t, uint64_t>>> indices;
+    };
+
+    struct deferred_transaction {
+        account_name      sender = 0;
+        uint128_t         sender_id = 0;
+        account_name      payer = 0;
+        uint32_t          execute_at = 0;
+        uint64_t          sequence = 0;
+        std::vector<char> packed_trx;
+    };
+
+    struct counters {
+        uint64_t db_reads = 0;
+        uint64_t db_writes = 0;
+        uint64_t bytes_read = 0;
+        uint64_t bytes_written = 0;
+    };
+
+    //nodeos 1.x的可计费大小：每行和每条二级索引的固定开销
+    static constexpr int64_t row_overhead = 108;
+    static constexpr int64_t index_overhead = 136;
+
+    inline int64_t billable_size(const row& r){
+        return int64_t(r.data.size()) + row_overhead + int64_t(r.secondary.size()) * index_overhead;
+    }
+
+    class chain {
+        public:
+            std::map<table_id, table>     db;
+            std::set<account_name>        accounts;
+            std::map<account_name, int64_t> ram_usage;
+            std::map<std::pair<account_name, uint128_t>, deferred_transaction> deferred;
+            uint64_t                      deferred_sequence = 0;
+            uint32_t                      now = 0;
+            counters                      stats;
+            std::string                   console;
+            //回放生产数据时无法预先知道所有账户，可以让is_account总是返回true
+            bool                          implicit_accounts = false;
+
+            //当前执行的action
+            account_name                  receiver = 0;
+            action                        current;
+            std::vector<account_name>     recipients;
+            std::vector<action>           inline_actions;
+
+            const table* find_table(const table_id& tid)const {
+                auto itr = db.find(tid);
+                return itr == db.end() ? nullptr : &itr->second;
+            }
+
+            const row* find_row(const table_id& tid, uint64_t pk)const {
+                auto t = find_table(tid);
+                if(!t) return nullptr;
+                auto itr = t->rows.find(pk);
+                return itr == t->rows.end() ? nullptr : &itr->second;
+            }
+
+            bool has_auth(account_name a)const {
+                for(const auto& p : current.authorization)
+                    if(p.actor == a) return true;
+                return false;
+            }
+
+            void emplace_row(const table_id& tid, uint64_t pk, row r){
+                eosio_assert(find_row(tid, pk) == nullptr, "could not insert object, most likely a uniqueness constraint was violated");
+                charge(r.payer, billable_size(r));
+                count_write(r);
+                touch(tid, pk);
+                raw_insert(tid, pk, std::move(r));
+            }
+
+            void update_row(const table_id& tid, uint64_t pk, std::vector<char> data, account_name payer, std::vector<uint128_t> secondary){
+                const row* old = find_row(tid, pk);
+                eosio_assert(old != nullptr, "object passed to modify is not in multi_index");
+                row r{std::move(data), payer ? payer : old->payer, std::move(secondary)};
+                int64_t old_size = billable_size(*old);
+                int64_t new_size = billable_size(r);
+                if(r.payer != old->payer){
+                    charge(old->payer, -old_size);
+                    charge(r.payer, new_size);
+                }else{
+                    charge(r.payer, new_size - old_size);
+                }
+                count_write(r);
+                touch(tid, pk);
+                raw_remove(tid, pk);
+                raw_insert(tid, pk, std::move(r));
+            }
+
+            void erase_row(const table_id& tid, uint64_t pk){
+                const row* old = find_row(tid, pk);
+                eosio_assert(old != nullptr, "object passed to erase is not in multi_index");
+                charge(old->payer, -billable_size(*old));
+                ++stats.db_writes;
+                touch(tid, pk);
+                raw_remove(tid, pk);
+            }
+
+            //从快照恢复，不计费也不记日志
+            void load_row(const table_id& tid, uint64_t pk, row r){
+                raw_remove(tid, pk);
+                raw_insert(tid, pk, std::move(r));
+            }
+
+            //事务：记录首次改动前的行，失败时整体回滚
+            void begin(){
+                journal.clear();
+                saved_ram = ram_usage;
+                saved_deferred = deferred;
+                saved_sequence = deferred_sequence;
+                journaling = true;
+            }
+
+            void commit(){
+                journal.clear();
+                journaling = false;
+            }
+
+            void rollback(){
+                for(auto& t : journal){
+                    for(auto& r : t.second){
+                        raw_remove(t.first, r.first);
+                        if(r.second.first) raw_insert(t.first, r.first, std::move(r.second.second));
+                    }
+                }
+                journal.clear();
+                ram_usage = std::move(saved_ram);
+                deferred = std::move(saved_deferred);
+                deferred_sequence = saved_sequence;
+                journaling = false;
+            }
+
+        private:
+            bool journaling = false;
+            std::map<table_id, std::map<uint64_t, std::pair<bool, row>>> journal;
+            std::map<account_name, int64_t> saved_ram;
+            std::map<std::pair<account_name, uint128_t>, deferred_transaction> saved_deferred;
+            uint64_t saved_sequence = 0;
+
+            void charge(account_name payer, int64_t delta){
+                if(delta > 0 && payer != receiver){
+                    eosio_assert(receiver == current.account, "cannot charge RAM to other accounts during notify");
+                    eosio_assert(has_auth(payer), ("unauthorized RAM usage increase: missing authority of " + name_to_string(payer)).c_str());
+                }
+                ram_usage[payer] += delta;
+            }
+
+            void count_write(const row& r){
+                ++stats.db_writes;
+                stats.bytes_written += r.data.size();
+            }
+
+            void touch(const table_id& tid, uint64_t pk){
+                if(!journaling) return;
+                auto& t = journal[tid];
+                if(t.count(pk)) return;
+                const row* r = find_row(tid, pk);
+                t.emplace(pk, r ? std::make_pair(true, *r) : std::make_pair(false, row()));
+            }
+
+            void raw_insert(const table_id& tid, uint64_t pk, row r){
+                auto& t = db[tid];
+                if(t.indices.size() < r.secondary.size()) t.indices.resize(r.secondary.size());
+                for(size_t i = 0; i < r.secondary.size(); ++i)
+                    t.indices[i].emplace(r.secondary[i], pk);
+                t.rows.emplace(pk, std::move(r));
+            }
+
+            void raw_remove(const table_id& tid, uint64_t pk){
+                auto titr = db.find(tid);
+                if(titr == db.end()) return;
+                auto ritr = titr->second.rows.find(pk);
+                if(ritr == titr->second.rows.end()) return;
+                for(size_t i = 0; i < ritr->second.secondary.size(); ++i)
+                    titr->second.indices[i].erase(std::make_pair(ritr->second.secondary[i], pk));
+                titr->second.rows.erase(ritr);
+            }
+    };
+
+    inline chain& state(){
+        static thread_local chain c;
+        return c;
+    }
+
+} }
+
+namespace eosio {
+
+    inline void action::send()const {
+        host::state().inline_actions.push_back(*this);
+    }
+
+    template<typename T>
+    T unpack_action_data(){
+        return unpack<T>(host::state().current.data);
+    }
+
+}
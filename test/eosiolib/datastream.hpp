@@ -0,0 +1,251 @@
+#pragma once
+#include <eosiolib/types.hpp>
+#include <vector>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace eosio {
+
+    template<typename T>
+    class datastream {
+        public:
+            datastream(T start, size_t s) : _start(start), _pos(start), _end(start + s) {}
+
+            void skip(size_t s){ _pos += s; }
+
+            bool read(char* d, size_t s){
+                eosio_assert(size_t(_end - _pos) >= s, "read");
+                memcpy(d, _pos, s);
+                _pos += s;
+                return true;
+            }
+
+            bool write(const char* d, size_t s){
+                eosio_assert(size_t(_end - _pos) >= s, "write");
+                memcpy((void*)_pos, d, s);
+                _pos += s;
+                return true;
+            }
+
+            bool put(char c){
+                eosio_assert(_pos < _end, "put");
+                *(char*)_pos = c;
+                ++_pos;
+                return true;
+            }
+
+            bool get(unsigned char& c){ return get(*(char*)&c); }
+            bool get(char& c){
+                eosio_assert(_pos < _end, "get");
+                c = *_pos;
+                ++_pos;
+                return true;
+            }
+
+            T pos()const { return _pos; }
+            bool valid()const { return _pos <= _end && _pos >= _start; }
+            size_t tellp()const { return size_t(_pos - _start); }
+            size_t remaining()const { return size_t(_end - _pos); }
+
+        private:
+            T _start;
+            T _pos;
+            T _end;
+    };
+
+    //只统计字节数，用于pack_size
+    template<>
+    class datastream<size_t> {
+        public:
+            datastream(size_t init_size = 0) : _size(init_size) {}
+            bool skip(size_t s){ _size += s; return true; }
+            bool write(const char*, size_t s){ _size += s; return true; }
+            bool put(char){ ++_size; return true; }
+            bool valid()const { return true; }
+            size_t tellp()const { return _size; }
+            size_t remaining()const { return 0; }
+        private:
+            size_t _size;
+    };
+
+    template<typename T> struct is_datastream : std::false_type {};
+    template<typename T> struct is_datastream<datastream<T>> : std::true_type {};
+
+    template<typename Stream, typename T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value>* = nullptr>
+    datastream<Stream>& operator<<(datastream<Stream>& ds, const T& v){
+        ds.write((const char*)&v, sizeof(T));
+        return ds;
+    }
+
+    template<typename Stream, typename T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value>* = nullptr>
+    datastream<Stream>& operator>>(datastream<Stream>& ds, T& v){
+        ds.read((char*)&v, sizeof(T));
+        return ds;
+    }
+
+    template<typename Stream>
+    datastream<Stream>& operator<<(datastream<Stream>& ds, const name& v){ return ds << v.value; }
+
+    template<typename Stream>
+    datastream<Stream>& operator>>(datastream<Stream>& ds, name& v){ return ds >> v.value; }
+
+}
+
+#include <eosiolib/varint.hpp>
+
+namespace eosio {
+
+    template<typename Stream>
+    datastream<Stream>& operator<<(datastream<Stream>& ds, const std::string& v){
+        ds << unsigned_int((uint32_t)v.size());
+        if(v.size()) ds.write(v.data(), v.size());
+        return ds;
+    }
+
+    template<typename Stream>
+    datastream<Stream>& operator>>(datastream<Stream>& ds, std::string& v){
+        unsigned_int s;
+        ds >> s;
+        v.resize(s.value);
+        if(s.value) ds.read(&v[0], s.value);
+        return ds;
+    }
+
+    template<typename Stream, typename T>
+    datastream<Stream>& operator<<(datastream<Stream>& ds, const std::vector<T>& v){
+        ds << unsigned_int((uint32_t)v.size());
+        for(const auto& i : v) ds << i;
+        return ds;
+    }
+
+    template<typename Stream, typename T>
+    datastream<Stream>& operator>>(datastream<Stream>& ds, std::vector<T>& v){
+        unsigned_int s;
+        ds >> s;
+        v.resize(s.value);
+        for(auto& i : v) ds >> i;
+        return ds;
+    }
+
+    template<typename Stream, typename... Args>
+    datastream<Stream>& operator<<(datastream<Stream>& ds, const std::tuple<Args...>& t){
+        std::apply([&ds](const auto&... e){ (void)std::initializer_list<int>{(ds << e, 0)...}; }, t);
+        return ds;
+    }
+
+    template<typename Stream, typename... Args>
+    datastream<Stream>& operator>>(datastream<Stream>& ds, std::tuple<Args...>& t){
+        std::apply([&ds](auto&... e){ (void)std::initializer_list<int>{(ds >> e, 0)...}; }, t);
+        return ds;
+    }
+
+    //没有EOSLIB_SERIALIZE的聚合体（如asset_entry），按字段顺序序列化，和eosiolib借助boost::pfr的行为一致
+    namespace reflect {
+
+        struct any_field {
+            template<typename T> operator T()const;
+        };
+
+        template<typename T, typename... A>
+        constexpr auto braces(int) -> decltype(T{std::declval<A>()...}, true) { return true; }
+        template<typename T, typename... A>
+        constexpr bool braces(...) { return false; }
+
+        template<typename T, size_t... I>
+        constexpr bool braces_n(std::index_sequence<I...>){
+            return braces<T, decltype((void)I, any_field())...>(0);
+        }
+
+        //从多到少试探，取能聚合初始化的最大字段数
+        template<typename T, size_t N = 8>
+        constexpr size_t field_count(){
+            if constexpr(N == 0) return 0;
+            else if constexpr(braces_n<T>(std::make_index_sequence<N>())) return N;
+            else return field_count<T, N - 1>();
+        }
+
+        template<typename T, typename F>
+        void for_each_field(T&& v, F&& f){
+            constexpr size_t n = field_count<std::decay_t<T>>();
+            static_assert(n > 0, "aggregate has no serializable fields");
+            if constexpr(n == 1){ auto& [a] = v; f(a); }
+            else if constexpr(n == 2){ auto& [a, b] = v; f(a); f(b); }
+            else if constexpr(n == 3){ auto& [a, b, c] = v; f(a); f(b); f(c); }
+            else if constexpr(n == 4){ auto& [a, b, c, d] = v; f(a); f(b); f(c); f(d); }
+            else if constexpr(n == 5){ auto& [a, b, c, d, e] = v; f(a); f(b); f(c); f(d); f(e); }
+            else if constexpr(n == 6){ auto& [a, b, c, d, e, g] = v; f(a); f(b); f(c); f(d); f(e); f(g); }
+            else if constexpr(n == 7){ auto& [a, b, c, d, e, g, h] = v; f(a); f(b); f(c); f(d); f(e); f(g); f(h); }
+            else { auto& [a, b, c, d, e, g, h, i] = v; f(a); f(b); f(c); f(d); f(e); f(g); f(h); f(i); }
+        }
+
+        template<typename T>
+        struct is_reflectable : std::integral_constant<bool, std::is_class<T>::value && std::is_aggregate<T>::value> {};
+
+    }
+
+    template<typename DataStream, typename T, std::enable_if_t<is_datastream<DataStream>::value && reflect::is_reflectable<T>::value>* = nullptr>
+    DataStream& operator<<(DataStream& ds, const T& v){
+        reflect::for_each_field(v, [&ds](const auto& f){ ds << f; });
+        return ds;
+    }
+
+    template<typename DataStream, typename T, std::enable_if_t<is_datastream<DataStream>::value && reflect::is_reflectable<T>::value>* = nullptr>
+    DataStream& operator>>(DataStream& ds, T& v){
+        reflect::for_each_field(v, [&ds](auto& f){ ds >> f; });
+        return ds;
+    }
+
+    template<typename T>
+    size_t pack_size(const T& value){
+        datastream<size_t> ps;
+        ps << value;
+        return ps.tellp();
+    }
+
+    template<typename T>
+    std::vector<char> pack(const T& value){
+        std::vector<char> result(pack_size(value));
+        datastream<char*> ds(result.data(), result.size());
+        ds << value;
+        return result;
+    }
+
+    template<typename T>
+    T unpack(const char* buffer, size_t len){
+        T result;
+        datastream<const char*> ds(buffer, len);
+        ds >> result;
+        return result;
+    }
+
+    template<typename T>
+    T unpack(const std::vector<char>& bytes){
+        return unpack<T>(bytes.data(), bytes.size());
+    }
+
+}
+
+#define EOSLIB_SERIALIZE_CAT(a, b) EOSLIB_SERIALIZE_CAT_I(a, b)
+#define EOSLIB_SERIALIZE_CAT_I(a, b) a ## b
+#define EOSLIB_SERIALIZE_OUT_A(m) ds << t.m; EOSLIB_SERIALIZE_OUT_B
+#define EOSLIB_SERIALIZE_OUT_B(m) ds << t.m; EOSLIB_SERIALIZE_OUT_A
+#define EOSLIB_SERIALIZE_OUT_A_END
+#define EOSLIB_SERIALIZE_OUT_B_END
+#define EOSLIB_SERIALIZE_IN_A(m) ds >> t.m; EOSLIB_SERIALIZE_IN_B
+#define EOSLIB_SERIALIZE_IN_B(m) ds >> t.m; EOSLIB_SERIALIZE_IN_A
+#define EOSLIB_SERIALIZE_IN_A_END
+#define EOSLIB_SERIALIZE_IN_B_END
+
+#define EOSLIB_SERIALIZE(TYPE, MEMBERS) \
+    template<typename DataStream> \
+    friend DataStream& operator<<(DataStream& ds, const TYPE& t){ \
+        EOSLIB_SERIALIZE_CAT(EOSLIB_SERIALIZE_OUT_A MEMBERS, _END) \
+        return ds; \
+    } \
+    template<typename DataStream> \
+    friend DataStream& operator>>(DataStream& ds, TYPE& t){ \
+        EOSLIB_SERIALIZE_CAT(EOSLIB_SERIALIZE_IN_A MEMBERS, _END) \
+        return ds; \
+    }
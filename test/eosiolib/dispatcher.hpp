@@ -0,0 +1,27 @@
+#pragma once
+#include <eosiolib/chain.hpp>
+
+namespace eosio {
+
+    template<typename T, typename Q, typename... Args>
+    bool execute_action(T* obj, void (Q::*func)(Args...)){
+        auto args = unpack_action_data<std::tuple<std::decay_t<Args>...>>();
+        std::apply([obj, func](auto&&... a){ (obj->*func)(a...); }, args);
+        return true;
+    }
+
+}
+
+#define EOSIO_API_CALL_A(elem) \
+    case ::eosio::string_to_name(#elem): ::eosio::execute_action(&thiscontract, &std::decay_t<decltype(thiscontract)>::elem); break; \
+    EOSIO_API_CALL_B
+#define EOSIO_API_CALL_B(elem) \
+    case ::eosio::string_to_name(#elem): ::eosio::execute_action(&thiscontract, &std::decay_t<decltype(thiscontract)>::elem); break; \
+    EOSIO_API_CALL_A
+#define EOSIO_API_CALL_A_END
+#define EOSIO_API_CALL_B_END
+
+#define EOSIO_API(TYPE, MEMBERS) \
+    EOSIO_SERIALIZE_API_CAT(EOSIO_API_CALL_A MEMBERS, _END)
+#define EOSIO_SERIALIZE_API_CAT(a, b) EOSIO_SERIALIZE_API_CAT_I(a, b)
+#define EOSIO_SERIALIZE_API_CAT_I(a, b) a ## b
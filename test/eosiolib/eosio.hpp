@@ -0,0 +1,10 @@
+#pragma once
+#include <eosiolib/types.hpp>
+#include <eosiolib/datastream.hpp>
+#include <eosiolib/action.hpp>
+#include <eosiolib/system.hpp>
+#include <eosiolib/multi_index.hpp>
+#include <eosiolib/contract.hpp>
+#include <eosiolib/dispatcher.hpp>
+
+typedef uint32_t time;
@@ -0,0 +1,365 @@
+#pragma once
+//multi_index替身：对象按作用域缓存，写操作直接落到宿主机数据库
+#include <eosiolib/system.hpp>
+#include <map>
+
+namespace eosio {
+
+    template<uint64_t IndexName, typename Extractor>
+    struct indexed_by {
+        enum constants { index_name = IndexName };
+        typedef Extractor secondary_extractor_type;
+    };
+
+    template<class Class, typename Type, Type (Class::*PtrToMemberFunction)()const>
+    struct const_mem_fun {
+        typedef typename std::remove_cv<typename std::remove_reference<Type>::type>::type result_type;
+
+        result_type operator()(const Class& x)const { return (x.*PtrToMemberFunction)(); }
+    };
+
+    template<uint64_t TableName, typename T, typename... Indices>
+    class multi_index {
+        private:
+            static constexpr size_t index_count = sizeof...(Indices);
+            typedef std::set<std::pair<uint128_t, uint64_t>> secondary_set;
+
+            account_name _code;
+            uint64_t     _scope;
+            //与eosiolib一致：每个实例缓存自己加载过的对象，引用在对象被删除前保持有效
+            mutable std::map<uint64_t, T> _items;
+
+            host::table_id tid()const { return {_code, _scope, TableName}; }
+
+            const std::map<uint64_t, host::row>& rows()const {
+                static const std::map<uint64_t, host::row> empty;
+                auto t = host::state().find_table(tid());
+                return t ? t->rows : empty;
+            }
+
+            const secondary_set& index_set(size_t i)const {
+                static const secondary_set empty;
+                auto t = host::state().find_table(tid());
+                return (t && t->indices.size() > i) ? t->indices[i] : empty;
+            }
+
+            template<size_t I>
+            static uint128_t secondary_key(const T& obj){
+                typedef typename std::tuple_element<I, std::tuple<Indices...>>::type index_type;
+                return (uint128_t)typename index_type::secondary_extractor_type()(obj);
+            }
+
+            template<size_t... I>
+            static std::vector<uint128_t> secondary_keys(const T& obj, std::index_sequence<I...>){
+                return std::vector<uint128_t>{secondary_key<I>(obj)...};
+            }
+
+            static std::vector<uint128_t> keys_of(const T& obj){
+                return secondary_keys(obj, std::make_index_sequence<index_count>());
+            }
+
+            template<uint64_t IndexName>
+            static constexpr size_t index_position(){
+                constexpr uint64_t names[] = {(uint64_t)Indices::index_name..., 0};
+                for(size_t i = 0; i < index_count; ++i)
+                    if(names[i] == IndexName) return i;
+                return index_count;
+            }
+
+            const T& load(uint64_t pk)const {
+                auto itr = _items.find(pk);
+                if(itr != _items.end()) return itr->second;
+                const host::row* r = host::state().find_row(tid(), pk);
+                eosio_assert(r != nullptr, "unable to find key");
+                auto& stats = host::state().stats;
+                ++stats.db_reads;
+                stats.bytes_read += r->data.size();
+                return _items.emplace(pk, unpack<T>(r->data)).first->second;
+            }
+
+            void check_owned(const T& obj, const char* msg)const {
+                auto itr = _items.find(obj.primary_key());
+                eosio_assert(itr != _items.end() && &itr->second == &obj, msg);
+            }
+
+        public:
+            multi_index(uint64_t code, uint64_t scope) : _code(code), _scope(scope) {}
+            multi_index(const multi_index&) = delete;
+            multi_index& operator=(const multi_index&) = delete;
+
+            uint64_t get_code()const { return _code; }
+            uint64_t get_scope()const { return _scope; }
+
+            struct const_iterator {
+                const multi_index* _multidx = nullptr;
+                uint64_t           _pk = 0;
+                bool               _end = true;
+
+                const T& operator*()const {
+                    eosio_assert(!_end, "cannot dereference end iterator");
+                    return _multidx->load(_pk);
+                }
+                const T* operator->()const { return &**this; }
+
+                const_iterator& operator++(){
+                    eosio_assert(!_end, "cannot increment end iterator");
+                    ++host::state().stats.db_reads;
+                    const auto& r = _multidx->rows();
+                    auto next = r.upper_bound(_pk);
+                    if(next == r.end()) _end = true;
+                    else _pk = next->first;
+                    return *this;
+                }
+                const_iterator operator++(int){ const_iterator t = *this; ++(*this); return t; }
+
+                const_iterator& operator--(){
+                    ++host::state().stats.db_reads;
+                    const auto& r = _multidx->rows();
+                    if(_end){
+                        eosio_assert(!r.empty(), "cannot decrement end iterator when the table is empty");
+                        _pk = r.rbegin()->first;
+                        _end = false;
+                    }else{
+                        auto itr = r.lower_bound(_pk);
+                        eosio_assert(itr != r.begin(), "cannot decrement iterator at beginning of table");
+                        --itr;
+                        _pk = itr->first;
+                    }
+                    return *this;
+                }
+                const_iterator operator--(int){ const_iterator t = *this; --(*this); return t; }
+
+                friend bool operator==(const const_iterator& a, const const_iterator& b){
+                    return a._multidx == b._multidx && a._end == b._end && (a._end || a._pk == b._pk);
+                }
+                friend bool operator!=(const const_iterator& a, const const_iterator& b){ return !(a == b); }
+            };
+
+            template<size_t I>
+            class index {
+                private:
+                    typedef typename std::tuple_element<I, std::tuple<Indices...>>::type index_type;
+                    typedef typename index_type::secondary_extractor_type extractor_type;
+                    multi_index* _multidx;
+
+                public:
+                    typedef typename extractor_type::result_type secondary_key_type;
+
+                    explicit index(multi_index* m) : _multidx(m) {}
+
+                    struct const_iterator {
+                        const multi_index* _multidx = nullptr;
+                        uint128_t          _key = 0;
+                        uint64_t           _pk = 0;
+                        bool               _end = true;
+
+                        const T& operator*()const {
+                            eosio_assert(!_end, "cannot dereference end iterator");
+                            return _multidx->load(_pk);
+                        }
+                        const T* operator->()const { return &**this; }
+
+                        const_iterator& operator++(){
+                            eosio_assert(!_end, "cannot increment end iterator");
+                            ++host::state().stats.db_reads;
+                            const auto& s = _multidx->index_set(I);
+                            auto next = s.upper_bound(std::make_pair(_key, _pk));
+                            if(next == s.end()) _end = true;
+                            else{ _key = next->first; _pk = next->second; }
+                            return *this;
+                        }
+                        const_iterator operator++(int){ const_iterator t = *this; ++(*this); return t; }
+
+                        const_iterator& operator--(){
+                            ++host::state().stats.db_reads;
+                            const auto& s = _multidx->index_set(I);
+                            typename secondary_set::const_iterator itr;
+                            if(_end){
+                                eosio_assert(!s.empty(), "cannot decrement end iterator when the index is empty");
+                                itr = s.end();
+                            }else{
+                                itr = s.lower_bound(std::make_pair(_key, _pk));
+                                eosio_assert(itr != s.begin(), "cannot decrement iterator at beginning of index");
+                            }
+                            --itr;
+                            _key = itr->first;
+                            _pk = itr->second;
+                            _end = false;
+                            return *this;
+                        }
+                        const_iterator operator--(int){ const_iterator t = *this; --(*this); return t; }
+
+                        friend bool operator==(const const_iterator& a, const const_iterator& b){
+                            return a._multidx == b._multidx && a._end == b._end && (a._end || (a._key == b._key && a._pk == b._pk));
+                        }
+                        friend bool operator!=(const const_iterator& a, const const_iterator& b){ return !(a == b); }
+                    };
+
+                    const_iterator make(typename secondary_set::const_iterator itr)const {
+                        const auto& s = _multidx->index_set(I);
+                        if(itr == s.end()) return end();
+                        return const_iterator{_multidx, itr->first, itr->second, false};
+                    }
+
+                    const_iterator begin()const {
+                        ++host::state().stats.db_reads;
+                        return make(_multidx->index_set(I).begin());
+                    }
+                    const_iterator end()const { return const_iterator{_multidx, 0, 0, true}; }
+                    const_iterator cbegin()const { return begin(); }
+                    const_iterator cend()const { return end(); }
+
+                    const_iterator lower_bound(secondary_key_type key)const {
+                        ++host::state().stats.db_reads;
+                        return make(_multidx->index_set(I).lower_bound(std::make_pair((uint128_t)key, uint64_t(0))));
+                    }
+
+                    const_iterator upper_bound(secondary_key_type key)const {
+                        ++host::state().stats.db_reads;
+                        return make(_multidx->index_set(I).upper_bound(std::make_pair((uint128_t)key, ~uint64_t(0))));
+                    }
+
+                    const_iterator find(secondary_key_type key)const {
+                        auto itr = lower_bound(key);
+                        if(itr == end() || itr._key != (uint128_t)key) return end();
+                        return itr;
+                    }
+
+                    const T& get(secondary_key_type key, const char* error_msg = "unable to find secondary key")const {
+                        auto itr = find(key);
+                        eosio_assert(itr != end(), error_msg);
+                        return *itr;
+                    }
+
+                    const_iterator iterator_to(const T& obj)const {
+                        _multidx->check_owned(obj, "object passed to iterator_to is not in multi_index");
+                        return const_iterator{_multidx, secondary_key<I>(obj), obj.primary_key(), false};
+                    }
+
+                    template<typename Lambda>
+                    void modify(const_iterator itr, uint64_t payer, Lambda&& updater){
+                        eosio_assert(itr != end(), "cannot pass end iterator to modify");
+                        _multidx->modify(*itr, payer, std::forward<Lambda>(updater));
+                    }
+
+                    const_iterator erase(const_iterator itr){
+                        eosio_assert(itr != end(), "cannot pass end iterator to erase");
+                        const T& obj = *itr;
+                        auto next = itr;
+                        ++next;
+                        _multidx->erase(obj);
+                        return next;
+                    }
+
+                    uint64_t get_code()const { return _multidx->get_code(); }
+                    uint64_t get_scope()const { return _multidx->get_scope(); }
+            };
+
+            template<uint64_t IndexName>
+            auto get_index(){
+                constexpr size_t I = index_position<IndexName>();
+                static_assert(I < index_count, "name provided is not the name of any secondary index within multi_index");
+                return index<I>(this);
+            }
+
+            template<uint64_t IndexName>
+            auto get_index()const {
+                constexpr size_t I = index_position<IndexName>();
+                static_assert(I < index_count, "name provided is not the name of any secondary index within multi_index");
+                return index<I>(const_cast<multi_index*>(this));
+            }
+
+            const_iterator make(typename std::map<uint64_t, host::row>::const_iterator itr)const {
+                if(itr == rows().end()) return end();
+                return const_iterator{this, itr->first, false};
+            }
+
+            const_iterator begin()const {
+                ++host::state().stats.db_reads;
+                return make(rows().begin());
+            }
+            const_iterator end()const { return const_iterator{this, 0, true}; }
+            const_iterator cbegin()const { return begin(); }
+            const_iterator cend()const { return end(); }
+
+            const_iterator lower_bound(uint64_t primary)const {
+                ++host::state().stats.db_reads;
+                return make(rows().lower_bound(primary));
+            }
+
+            const_iterator upper_bound(uint64_t primary)const {
+                ++host::state().stats.db_reads;
+                return make(rows().upper_bound(primary));
+            }
+
+            const_iterator find(uint64_t primary)const {
+                ++host::state().stats.db_reads;
+                return make(rows().find(primary));
+            }
+
+            const T& get(uint64_t primary, const char* error_msg = "unable to find key")const {
+                auto itr = find(primary);
+                eosio_assert(itr != end(), error_msg);
+                return *itr;
+            }
+
+            const_iterator iterator_to(const T& obj)const {
+                check_owned(obj, "object passed to iterator_to is not in multi_index");
+                return const_iterator{this, obj.primary_key(), false};
+            }
+
+            uint64_t available_primary_key()const {
+                const auto& r = rows();
+                if(r.empty()) return 0;
+                eosio_assert(r.rbegin()->first < ~uint64_t(0) - 1, "next primary key in table is at autoincrement limit");
+                return r.rbegin()->first + 1;
+            }
+
+            template<typename Lambda>
+            const_iterator emplace(uint64_t payer, Lambda&& constructor){
+                eosio_assert(_code == current_receiver(), "cannot create objects in table of another contract");
+                T obj;
+                constructor(obj);
+                uint64_t pk = obj.primary_key();
+                host::state().emplace_row(tid(), pk, host::row{pack(obj), payer, keys_of(obj)});
+                _items.erase(pk);
+                _items.emplace(pk, std::move(obj));
+                return const_iterator{this, pk, false};
+            }
+
+            template<typename Lambda>
+            void modify(const_iterator itr, uint64_t payer, Lambda&& updater){
+                eosio_assert(itr != end(), "cannot pass end iterator to modify");
+                modify(*itr, payer, std::forward<Lambda>(updater));
+            }
+
+            template<typename Lambda>
+            void modify(const T& obj, uint64_t payer, Lambda&& updater){
+                eosio_assert(_code == current_receiver(), "cannot modify objects in table of another contract");
+                check_owned(obj, "object passed to modify is not in multi_index");
+                uint64_t pk = obj.primary_key();
+                T& mutable_obj = const_cast<T&>(obj);
+                updater(mutable_obj);
+                eosio_assert(pk == mutable_obj.primary_key(), "updater cannot change primary key when modifying an object");
+                host::state().update_row(tid(), pk, pack(obj), payer, keys_of(obj));
+            }
+
+            const_iterator erase(const_iterator itr){
+                eosio_assert(itr != end(), "cannot pass end iterator to erase");
+                const T& obj = *itr;
+                auto next = itr;
+                ++next;
+                erase(obj);
+                return next;
+            }
+
+            void erase(const T& obj){
+                eosio_assert(_code == current_receiver(), "cannot erase objects in table of another contract");
+                check_owned(obj, "object passed to erase is not in multi_index");
+                uint64_t pk = obj.primary_key();
+                host::state().erase_row(tid(), pk);
+                _items.erase(pk);
+            }
+    };
+
+}
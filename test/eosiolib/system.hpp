@@ -0,0 +1,57 @@
+#pragma once
+#include <eosiolib/chain.hpp>
+
+inline uint32_t now(){ return eosio::host::state().now; }
+inline uint64_t current_time(){ return uint64_t(eosio::host::state().now) * 1000000; }
+inline account_name current_receiver(){ return eosio::host::state().receiver; }
+
+inline bool has_auth(account_name name){ return eosio::host::state().has_auth(name); }
+
+inline void require_auth(account_name name){
+    eosio_assert(has_auth(name), ("missing authority of " + eosio::name_to_string(name)).c_str());
+}
+
+inline bool is_account(account_name name){
+    auto& c = eosio::host::state();
+    return c.implicit_accounts || c.accounts.count(name) > 0;
+}
+
+inline void require_recipient(account_name name){
+    auto& r = eosio::host::state().recipients;
+    for(auto a : r)
+        if(a == name) return;
+    r.push_back(name);
+}
+
+namespace eosio {
+
+    inline void print_one(std::string& out, const char* s){ out += s; }
+    inline void print_one(std::string& out, const std::string& s){ out += s; }
+    inline void print_one(std::string& out, char c){ out += c; }
+    inline void print_one(std::string& out, const name& n){ out += n.to_string(); }
+    inline void print_one(std::string& out, bool b){ out += b ? "true" : "false"; }
+
+    template<typename T, std::enable_if_t<std::is_integral<T>::value>* = nullptr>
+    void print_one(std::string& out, T v){
+        if(v < 0){
+            out += '-';
+            print_one(out, (uint128_t)(-(int128_t)v));
+            return;
+        }
+        char buf[48];
+        int n = 0;
+        uint128_t u = (uint128_t)v;
+        do{
+            buf[n++] = char('0' + int(u % 10));
+            u /= 10;
+        }while(u);
+        while(n) out += buf[--n];
+    }
+
+    template<typename... Args>
+    void print(Args&&... args){
+        auto& out = host::state().console;
+        (void)std::initializer_list<int>{(print_one(out, std::forward<Args>(args)), 0)...};
+    }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <eosiolib/action.hpp>
+
+namespace eosio {
+
+    typedef std::tuple<uint16_t, std::vector<char>> extension;
+
+    class transaction {
+        public:
+            uint32_t     expiration = 0;
+            uint16_t     ref_block_num = 0;
+            uint32_t     ref_block_prefix = 0;
+            unsigned_int max_net_usage_words = 0UL;
+            uint8_t      max_cpu_usage_ms = 0;
+            unsigned_int delay_sec = 0UL;
+
+            std::vector<action>    context_free_actions;
+            std::vector<action>    actions;
+            std::vector<extension> transaction_extensions;
+
+            //定义在chain.hpp
+            void send(const uint128_t& sender_id, account_name payer, bool replace_existing = false)const;
+
+            EOSLIB_SERIALIZE(transaction, (expiration)(ref_block_num)(ref_block_prefix)(max_net_usage_words)(max_cpu_usage_ms)(delay_sec)
+                                          (context_free_actions)(actions)(transaction_extensions))
+    };
+
+    struct onerror {
+        uint128_t         sender_id;
+        std::vector<char> sent_trx;
+
+        static onerror from_current_action(){ return unpack_action_data<onerror>(); }
+
+        transaction unpack_sent_trx()const { return unpack<transaction>(sent_trx); }
+
+        EOSLIB_SERIALIZE(onerror, (sender_id)(sent_trx))
+    };
+
+    bool cancel_deferred(const uint128_t& sender_id);
+
+}
+
+#include <eosiolib/chain.hpp>
+
+namespace eosio {
+
+    inline void transaction::send(const uint128_t& sender_id, account_name payer, bool replace_existing)const {
+        auto& c = host::state();
+        auto key = std::make_pair(c.receiver, sender_id);
+        eosio_assert(replace_existing || c.deferred.count(key) == 0, "deferred transaction with the same sender_id already exists");
+        host::deferred_transaction trx;
+        trx.sender = c.receiver;
+        trx.sender_id = sender_id;
+        trx.payer = payer;
+        trx.execute_at = c.now + delay_sec.value;
+        trx.sequence = c.deferred_sequence++;
+        trx.packed_trx = pack(*this);
+        c.deferred[key] = std::move(trx);
+    }
+
+    inline bool cancel_deferred(const uint128_t& sender_id){
+        auto& c = host::state();
+        return c.deferred.erase(std::make_pair(c.receiver, sender_id)) > 0;
+    }
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+//eosiolib的宿主机替身：只实现合约用到的接口，语义尽量与eosio 1.x一致
+//注意：eosio.hpp在全局定义了time类型，这里不能包含会引入<time.h>的标准头文件（<memory>、<iterator>、<chrono>等）
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <exception>
+
+typedef uint64_t account_name;
+typedef uint64_t permission_name;
+typedef uint64_t table_name;
+typedef uint64_t scope_name;
+typedef uint64_t action_name;
+typedef uint64_t symbol_name;
+typedef unsigned __int128 uint128_t;
+typedef __int128 int128_t;
+
+namespace eosio {
+
+    //eosio_assert失败时抛出，由tester回滚整个交易
+    struct assertion_failure : std::exception {
+        explicit assertion_failure(const char* msg) : message(msg ? msg : "") {}
+        const char* what()const noexcept override { return message.c_str(); }
+        std::string message;
+    };
+
+    static constexpr char char_to_symbol(char c){
+        if(c >= 'a' && c <= 'z')
+            return (c - 'a') + 6;
+        if(c >= '1' && c <= '5')
+            return (c - '1') + 1;
+        return 0;
+    }
+
+    static constexpr uint64_t string_to_name(const char* str){
+        uint32_t len = 0;
+        while(str[len]) ++len;
+
+        uint64_t value = 0;
+        for(uint32_t i = 0; i <= 12; ++i){
+            uint64_t c = 0;
+            if(i < len && i <= 12) c = uint64_t(char_to_symbol(str[i]));
+
+            if(i < 12){
+                c &= 0x1f;
+                c <<= 64 - 5 * (i + 1);
+            }else{
+                c &= 0x0f;
+            }
+            value |= c;
+        }
+        return value;
+    }
+
+    inline std::string name_to_string(uint64_t value){
+        static const char* charmap = ".12345abcdefghijklmnopqrstuvwxyz";
+        std::string str(13, '.');
+        uint64_t tmp = value;
+        for(uint32_t i = 0; i <= 12; ++i){
+            char c = charmap[tmp & (i == 0 ? 0x0f : 0x1f)];
+            str[12 - i] = c;
+            tmp >>= (i == 0 ? 4 : 5);
+        }
+        while(!str.empty() && str.back() == '.') str.pop_back();
+        return str;
+    }
+
+    struct name {
+        operator uint64_t()const { return value; }
+        std::string to_string()const { return name_to_string(value); }
+        uint64_t value = 0;
+    };
+
+}
+
+#define N(X) ::eosio::string_to_name(#X)
+
+inline void eosio_assert(uint32_t test, const char* msg){
+    if(!test) throw eosio::assertion_failure(msg);
+}
@@ -0,0 +1,361 @@
+//随机动作序列的模糊测试，每一步之后检查资金守恒等不变量，失败时把序列缩减为最小的复现步骤
+//用法：fuzz [--threads N] [--seconds S] [--runs R] [--steps L] [--seed S] [--record FILE]
+//--record只运行--seed指定的一个序列，并把合约接受的动作写成replay可读的日志
+#include "tables.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace test;
+
+static const int ACCOUNTS = 12;
+static const uint32_t hour = 3600;
+static const uint32_t day = 24 * hour;
+
+enum step_kind : uint8_t {
+    deposit, batch_transfer, batch_deposit, withdraw_credit, sell, stake, unstake, key_transfer,
+    propose, vote, vote_batch, delegate, undelegate, exec, del, settle, settle_batch,
+    compact, finalize, time_jump, migrate,
+    step_kinds
+};
+
+static const char* kind_names[] = {
+    "deposit", "batch_transfer", "batch_deposit", "withdraw_credit", "sell", "stake", "unstake", "key_transfer",
+    "propose", "vote", "vote_batch", "delegate", "undelegate", "exec", "del", "settle", "settle_batch",
+    "compact", "finalize", "time_jump", "migrate"
+};
+
+//数量在执行时按当前状态解释，缩减序列后步骤仍然有意义
+struct step {
+    uint8_t  kind;
+    uint8_t  a;
+    uint8_t  b;
+    uint8_t  c;
+    uint64_t r;
+};
+
+static account_name member(uint8_t i){ return account_for('f', i % ACCOUNTS); }
+
+static int64_t scaled(uint64_t r, int64_t max){
+    if(max <= 0) return 1;
+    return (int64_t)(r % (uint64_t)max) + 1;
+}
+
+//多数情况下选一个未结束的案例，偶尔选不存在或已结束的案例
+static uint64_t pick_case(tester& t, uint64_t r){
+    auto open = t.get_rows<proposal_row>(N(proposals), tester::code);
+    if(open.empty() || r % 8 == 0){
+        global_row gl;
+        t.get_row(N(global), tester::code, 0, gl);
+        return 1 + r % (gl.cases_num + 1);
+    }
+    return open[(r >> 3) % open.size()].case_id;
+}
+
+static bool apply_step(tester& t, const step& s){
+    account_name a = member(s.a);
+    account_name b = member(s.b);
+    auto row = get_balance(t, a);
+    switch(s.kind){
+        case deposit: {
+            std::string memo;
+            if(s.c % 4 == 1) memo = "\"buyfor\":\"" + eosio::name_to_string(b) + "\"";
+            if(s.c % 4 == 2) memo = "\"ref\":\"" + eosio::name_to_string(b) + "\"";
+            //金额跨越多个数量级，小额会员容易在赔付中耗尽担保金
+            return t.transfer(a, tester::code, eos(1000 + (int64_t)((s.r >> 8) % (1000 << (s.r % 12)))), memo).ok;
+        }
+        case batch_transfer:
+            return t.transfer(a, tester::code, eos(1000 + (int64_t)(s.r % (100 * 10000))), "\"batch\"").ok;
+        case batch_deposit: {
+            credit_row credit{a, eos(0)};
+            t.get_row(N(credits), tester::code, a, credit);
+            int64_t total = credit.balance.amount > 0 ? scaled(s.r, credit.balance.amount) : 1000;
+            std::vector<deposit_arg> deposits;
+            int n = 1 + s.c % 3;
+            for(int i = 0; i < n; i++){
+                deposits.push_back({member(s.b + i), eos(std::max<int64_t>(1000, total / n))});
+            }
+            return t.push_action(a, N(batchdeposit), a, deposits).ok;
+        }
+        case withdraw_credit:
+            return t.push_action(a, N(withdrawcredit), a).ok;
+        case sell:
+            return t.push_action(a, N(sellkey), a, key(scaled(s.r, row.key_balance))).ok;
+        case stake:
+            return t.push_action(a, N(stakekey), a, key(scaled(s.r, row.key_balance))).ok;
+        case unstake:
+            return t.push_action(a, N(unstakekey), a, asset(scaled(s.r, row.stake_balance), S(0,STKEY))).ok;
+        case key_transfer:
+            return t.push_action(a, N(transfer), a, b, key(scaled(s.r, row.key_balance)), std::string("fuzz")).ok;
+        case propose: {
+            global_row gl;
+            t.get_row(N(global), tester::code, 0, gl);
+            return t.push_action(a, N(propose), a, eosio::name{N(fuzz)}, eos(scaled(s.r, gl.guarantee_pool.amount + 10000))).ok;
+        }
+        case vote: {
+            uint64_t case_id = pick_case(t, s.r);
+            static const action_name directions[] = {N(approve), N(unapprove), N(cancelvote)};
+            return t.push_action(a, directions[s.c % 3], a, case_id).ok;
+        }
+        case vote_batch: {
+            std::vector<case_vote_arg> votes;
+            for(uint64_t i = 0, n = 1 + s.c % 3; i < n; i++){
+                votes.push_back({pick_case(t, s.r + (i << 3)), (uint8_t)((s.r >> (16 + i)) % 3)});
+            }
+            return t.push_action(a, N(votebatch), a, votes).ok;
+        }
+        case delegate:
+            return t.push_action(a, N(delegate), a, b).ok;
+        case undelegate:
+            return t.push_action(a, N(undelegate), a).ok;
+        case exec:
+        case del: {
+            uint64_t case_id = pick_case(t, s.r);
+            return t.push_action(a, s.kind == exec ? N(execproposal) : N(delproposal), a, case_id).ok;
+        }
+        case settle:
+            return t.push_action(b, N(settle), a).ok;
+        case settle_batch:
+            return t.push_action(a, N(settlebatch), (uint64_t)0, (uint64_t)(1 + s.c % 8)).ok;
+        case compact:
+            return t.push_action(a, N(compact)).ok;
+        case finalize:
+            return t.run_deferred() > 0;
+        case time_jump: {
+            static const uint32_t jumps[] = {1, hour, day, 10 * day, 31 * day, 181 * day};
+            t.produce(jumps[s.c % 6]);
+            return true;
+        }
+        case migrate:
+            return t.push_action(a, s.c % 2 ? N(migrate) : N(gcvotes), (uint64_t)(1 + s.c % 8)).ok;
+    }
+    return false;
+}
+
+//不变量不成立时返回描述，否则返回空字符串
+static std::string check_invariants(tester& t){
+    auto audit = t.push_action(tester::code, N(audit));
+    if(!audit.ok) return "audit: " + audit.error;
+
+    global_row gl;
+    if(!t.get_row(N(global), tester::code, 0, gl)) return "global missing";
+    int64_t guarantee_pool = gl.guarantee_pool.amount;
+    int64_t bonus_pool = gl.bonus_pool.amount;
+    int64_t guaranteed_accounts = (int64_t)gl.guaranteed_accounts;
+    for(const auto& s : t.get_rows<shard_row>(N(shards), tester::code)){
+        guarantee_pool += s.guarantee_pool;
+        bonus_pool += s.bonus_pool;
+        guaranteed_accounts += s.guaranteed_accounts;
+    }
+
+    int64_t credits = 0;
+    for(const auto& c : t.get_rows<credit_row>(N(credits), tester::code)){
+        if(c.balance.amount <= 0) return "non-positive credit";
+        credits += c.balance.amount;
+    }
+    //合约持有的EOS = 担保池 + 奖金池 + 未分配的批量额度
+    if(t.balance(tester::code) != guarantee_pool + bonus_pool + credits) return "contract EOS balance does not match the pools";
+
+    keymarket_row km;
+    t.get_row(N(keymarket), tester::code, S(0,KEY), km);
+    uint64_t index = claim_index(t);
+    int64_t keys = 0;
+    int64_t guaranteed = 0;
+    int64_t effective = 0;
+    std::map<account_name, int64_t> stakes;
+    for(auto scope : t.scopes(N(balances))){
+        balance_row m;
+        t.get_row(N(balances), scope, scope, m);
+        if(m.guarantee_balance < 0 || m.key_balance < 0 || m.stake_balance < 0) return "negative member balance";
+        keys += m.key_balance + m.stake_balance;
+        stakes[m.account] = m.stake_balance;
+        registry_row reg{0, 0};
+        bool registered = t.get_row(N(registry), tester::code, m.account, reg);
+        if(m.join_time > 0){
+            guaranteed++;
+            uint64_t owed = index - m.claim_snapshot;
+            effective += (uint64_t)m.guarantee_balance > owed ? m.guarantee_balance - (int64_t)owed : 0;
+            if(!registered || reg.join_time != m.join_time) return "guaranteed member missing from registry";
+        }else if(registered){
+            return "registry has a member without guarantee";
+        }
+    }
+    //KEY_INIT_SUPPLY不属于任何会员
+    if(keys != km.supply.amount - 1000000) return "member KEY does not match the supply";
+    if(guaranteed != guaranteed_accounts) return "guaranteed_accounts does not match the members";
+    if((int64_t)t.row_count(N(registry), tester::code) != guaranteed) return "registry size does not match the members";
+    //赔付按担保账户数从池中扣除，池中金额不会超过会员实际剩余的担保金
+    if(guarantee_pool > effective) return "guarantee pool exceeds the members' guarantees";
+
+    for(const auto& p : t.get_rows<proposal_row>(N(proposals), tester::code)){
+        int64_t yes = 0, no = 0;
+        for(const auto& b : t.get_rows<ballot_row>(N(ballots), p.case_id)){
+            (b.agreed ? yes : no) += b.weight;
+        }
+        if(yes != p.vote_yes || no != p.vote_no) return "case tally does not match the ballots";
+    }
+
+    std::map<account_name, std::pair<int64_t, uint64_t>> delegated;
+    for(const auto& d : t.get_rows<delegation_row>(N(delegations), tester::code)){
+        delegated[d.proxy].first += stakes[d.owner];
+        delegated[d.proxy].second++;
+    }
+    for(const auto& p : t.get_rows<proxy_row>(N(proxies), tester::code)){
+        if(p.delegated != delegated[p.proxy].first || p.delegators != delegated[p.proxy].second) return "proxy totals do not match the delegations";
+        delegated.erase(p.proxy);
+    }
+    if(!delegated.empty()) return "delegation to a missing proxy";
+    return std::string();
+}
+
+//warm为true时所有账户先充值并质押一半KEY，再经过观察期，使提案和投票从第一步起就可以成功
+static void start(tester& t, bool warm){
+    for(int i = 0; i < ACCOUNTS; i++){
+        t.create_account(member(i));
+        t.issue(member(i), 1000000LL * 10000);
+    }
+    REQUIRE_OK(t.push_action(tester::code, N(init), (uint64_t)300, (uint64_t)100, eos(1000 * 10000)));
+    if(!warm) return;
+    for(int i = 0; i < ACCOUNTS; i++){
+        REQUIRE_OK(t.transfer(member(i), tester::code, eos(100 * 10000)));
+        REQUIRE_OK(t.push_action(member(i), N(stakekey), member(i), key(get_balance(t, member(i)).key_balance / 2)));
+    }
+    t.produce(181 * day);
+}
+
+//各类步骤的执行次数和合约接受的次数，用于确认序列覆盖到了成功的路径
+static std::atomic<uint64_t> tried[step_kinds], accepted[step_kinds];
+
+//返回第一个不变量失败的步骤序号，全部通过返回-1
+static int run(const std::vector<step>& steps, bool warm, std::string& error, bool count = false, FILE* record = nullptr){
+    tester t;
+    t.record = record;
+    start(t, warm);
+    for(size_t i = 0; i < steps.size(); i++){
+        bool ok = apply_step(t, steps[i]);
+        if(count){
+            tried[steps[i].kind]++;
+            if(ok) accepted[steps[i].kind]++;
+        }
+        error = check_invariants(t);
+        if(!error.empty()) return (int)i;
+    }
+    return -1;
+}
+
+static std::vector<step> generate(uint64_t seed, size_t length){
+    std::mt19937_64 rng(seed);
+    std::vector<step> steps(length);
+    for(auto& s : steps){
+        uint64_t x = rng();
+        s.kind = (uint8_t)(x % step_kinds);
+        s.a = (uint8_t)(x >> 8);
+        s.b = (uint8_t)(x >> 16);
+        s.c = (uint8_t)(x >> 24);
+        s.r = rng();
+    }
+    return steps;
+}
+
+//delta debugging：反复删除能删除的步骤块，直到每一步都不可缺少
+static std::vector<step> shrink(std::vector<step> steps, bool warm, const std::string& error){
+    std::string e;
+    steps.resize(run(steps, warm, e) + 1);
+    for(size_t chunk = steps.size() / 2; chunk >= 1; chunk /= 2){
+        for(size_t begin = 0; begin + chunk <= steps.size(); ){
+            std::vector<step> candidate(steps.begin(), steps.begin() + begin);
+            candidate.insert(candidate.end(), steps.begin() + begin + chunk, steps.end());
+            int failed = run(candidate, warm, e);
+            if(failed >= 0 && e == error){
+                candidate.resize(failed + 1);
+                steps = candidate;
+            }else{
+                begin += chunk;
+            }
+        }
+    }
+    return steps;
+}
+
+int main(int argc, char** argv){
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t seconds = 0;
+    uint64_t runs = 1000;
+    size_t length = 200;
+    uint64_t seed = 1;
+    std::string record;
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string arg = argv[i];
+        if(arg == "--threads") threads = (unsigned)std::strtoul(argv[i + 1], nullptr, 10);
+        else if(arg == "--seconds") seconds = std::strtoull(argv[i + 1], nullptr, 10);
+        else if(arg == "--runs") runs = std::strtoull(argv[i + 1], nullptr, 10);
+        else if(arg == "--steps") length = std::strtoull(argv[i + 1], nullptr, 10);
+        else if(arg == "--seed") seed = std::strtoull(argv[i + 1], nullptr, 10);
+        else if(arg == "--record") record = argv[i + 1];
+    }
+
+    if(!record.empty()){
+        FILE* out = std::fopen(record.c_str(), "w");
+        if(!out){
+            std::printf("cannot write %s\n", record.c_str());
+            return 1;
+        }
+        std::string error;
+        int at = run(generate(seed, length), seed % 2 == 1, error, false, out);
+        std::fclose(out);
+        if(at >= 0) std::printf("seed %llu failed at step %d: %s\n", (unsigned long long)seed, at, error.c_str());
+        return at < 0 ? 0 : 1;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    auto deadline = begin + std::chrono::seconds(seconds);
+    std::atomic<uint64_t> next(seed), done(0), steps_done(0);
+    std::atomic<bool> failed(false);
+    std::mutex report;
+
+    auto worker = [&](){
+        while(!failed){
+            if(seconds ? std::chrono::steady_clock::now() >= deadline : done >= runs) break;
+            uint64_t s = next++;
+            if(!seconds && s >= seed + runs) break;
+            auto steps = generate(s, length);
+            std::string error;
+            bool warm = s % 2 == 1;
+            int at = run(steps, warm, error, true);
+            steps_done += at < 0 ? steps.size() : at + 1;
+            done++;
+            if(at < 0) continue;
+
+            bool first = !failed.exchange(true);
+            auto minimal = shrink(steps, warm, error);
+            std::lock_guard<std::mutex> lock(report);
+            if(!first) continue;
+            std::printf("seed %llu (%s start) failed at step %d: %s\nminimal reproducer (%zu steps):\n",
+                        (unsigned long long)s, warm ? "warm" : "empty", at, error.c_str(), minimal.size());
+            for(const auto& st : minimal){
+                std::printf("  %-14s a=%s b=%s c=%u r=%llu\n", kind_names[st.kind],
+                            eosio::name_to_string(member(st.a)).c_str(), eosio::name_to_string(member(st.b)).c_str(),
+                            st.c, (unsigned long long)st.r);
+            }
+            std::printf("rerun with --seed %llu --runs 1 --steps %zu\n", (unsigned long long)s, length);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < threads; i++) pool.emplace_back(worker);
+    for(auto& th : pool) th.join();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("%llu sequences, %llu steps in %.1fs (%.0f steps/min, %u threads)\n",
+                (unsigned long long)done.load(), (unsigned long long)steps_done.load(), elapsed,
+                steps_done / elapsed * 60, threads);
+    std::printf("accepted:");
+    for(int k = 0; k < step_kinds; k++){
+        std::printf(" %s %.0f%%", kind_names[k], tried[k] ? 100.0 * accepted[k] / tried[k] : 0.0);
+    }
+    std::printf("\n");
+    return failed ? 1 : 0;
+}
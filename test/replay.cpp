@@ -0,0 +1,324 @@
+//把生产环境导出的动作日志逐条送进apply，统计每种动作的耗时分布
+//日志每行一个顶层action，字段同nodeos历史插件：time(秒或ISO时间，也可以是block_time)、account、name、authorization、hex_data
+//eosio.token的transfer经由模拟的代币合约通知到apply，合约发出的inline action由回放重新产生
+//用法：replay LOG [--snapshot-every N] [--snapshot-dir DIR] [--resume FILE] [--stop-at LINE] [--deferred] [--verify-resume]
+//快照与合约版本无关：用一个版本回放到某一行保存快照，再用另一个版本从快照继续，可以二分定位性能回退
+#include "tester.hpp"
+#include <chrono>
+#include <fstream>
+#include <string>
+
+using namespace test;
+
+struct options {
+    uint64_t    snapshot_every = 0;
+    std::string snapshot_dir = ".";
+    uint64_t    stop_at = 0;
+    bool        deferred = false;
+    bool        quiet = false;
+};
+
+struct latency {
+    std::vector<uint64_t> ns;
+    uint64_t              failed = 0;
+};
+
+struct replay_result {
+    uint64_t                       actions = 0;
+    uint64_t                       failed = 0;
+    uint64_t                       auto_issued = 0;
+    std::vector<uint64_t>          snapshots;
+    std::map<std::string, latency> stats;
+};
+
+static const char snapshot_magic[8] = {'H', 'B', 'T', 'S', 'N', 'A', 'P', '1'};
+
+static size_t find_value(const std::string& s, const char* key, size_t from, size_t to){
+    std::string quoted = std::string("\"") + key + "\"";
+    size_t at = s.find(quoted, from);
+    if(at == std::string::npos || at >= to) return std::string::npos;
+    at += quoted.size();
+    while(at < to && (s[at] == ' ' || s[at] == ':')) at++;
+    return at < to ? at : std::string::npos;
+}
+
+static bool json_string(const std::string& s, const char* key, size_t from, size_t to, std::string& out){
+    size_t at = find_value(s, key, from, to);
+    if(at == std::string::npos || s[at] != '"') return false;
+    size_t end = s.find('"', at + 1);
+    if(end == std::string::npos || end >= to) return false;
+    out = s.substr(at + 1, end - at - 1);
+    return true;
+}
+
+//2018-07-01T00:00:00.000，按UTC解释
+static bool parse_iso_time(const std::string& v, uint32_t& out){
+    int y, mo, d, h, mi, sec;
+    if(std::sscanf(v.c_str(), "%d-%d-%dT%d:%d:%d", &y, &mo, &d, &h, &mi, &sec) != 6) return false;
+    y -= mo <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = (int64_t)era * 146097 + doe - 719468;
+    out = (uint32_t)(days * 86400 + h * 3600 + mi * 60 + sec);
+    return true;
+}
+
+static bool parse_line(const std::string& s, uint32_t& time, action& act, std::string& error){
+    size_t end = s.size();
+    std::string v;
+    size_t at = find_value(s, "time", 0, end);
+    if(at == std::string::npos) at = find_value(s, "block_time", 0, end);
+    if(at == std::string::npos){ error = "missing time"; return false; }
+    if(s[at] == '"'){
+        if(!json_string(s, "time", 0, end, v) && !json_string(s, "block_time", 0, end, v)){ error = "bad time"; return false; }
+        if(!parse_iso_time(v, time)){ error = "bad time"; return false; }
+    }else{
+        time = (uint32_t)std::strtoul(s.c_str() + at, nullptr, 10);
+    }
+
+    if(!json_string(s, "account", 0, end, v)){ error = "missing account"; return false; }
+    act.account = eosio::string_to_name(v.c_str());
+    if(!json_string(s, "name", 0, end, v)){ error = "missing name"; return false; }
+    act.name = eosio::string_to_name(v.c_str());
+
+    act.authorization.clear();
+    at = find_value(s, "authorization", 0, end);
+    if(at == std::string::npos || s[at] != '['){ error = "missing authorization"; return false; }
+    size_t close = s.find(']', at);
+    if(close == std::string::npos){ error = "bad authorization"; return false; }
+    for(size_t obj = s.find('{', at); obj != std::string::npos && obj < close; obj = s.find('{', obj + 1)){
+        size_t obj_end = s.find('}', obj);
+        std::string actor, permission;
+        if(!json_string(s, "actor", obj, obj_end, actor) || !json_string(s, "permission", obj, obj_end, permission)){
+            error = "bad authorization";
+            return false;
+        }
+        act.authorization.push_back(permission_level{eosio::string_to_name(actor.c_str()), eosio::string_to_name(permission.c_str())});
+    }
+
+    if(!json_string(s, "hex_data", 0, end, v) || v.size() % 2){ error = "missing hex_data"; return false; }
+    act.data.resize(v.size() / 2);
+    for(size_t i = 0; i < act.data.size(); i++){
+        act.data[i] = (char)std::strtoul(v.substr(i * 2, 2).c_str(), nullptr, 16);
+    }
+    return true;
+}
+
+//日志里的延迟交易已经执行过，回放时从待执行队列里移除，避免重复执行或sender_id冲突
+static void consume_deferred(tester& t, const action& act){
+    auto& deferred = t.chain().deferred;
+    if(act.account == N(eosio) && act.name == N(onerror)){
+        auto err = eosio::unpack<eosio::onerror>(act.data);
+        auto itr = deferred.find(std::make_pair(act.authorization[0].actor, err.sender_id));
+        if(itr != deferred.end() && itr->second.packed_trx == err.sent_trx) deferred.erase(itr);
+        return;
+    }
+    if(act.authorization.empty() || act.authorization[0].actor != act.account) return;
+    auto found = deferred.end();
+    for(auto itr = deferred.begin(); itr != deferred.end(); ++itr){
+        if(found != deferred.end() && itr->second.sequence > found->second.sequence) continue;
+        for(const auto& a : eosio::unpack<eosio::transaction>(itr->second.packed_trx).actions){
+            if(a.account == act.account && a.name == act.name && a.data == act.data){
+                found = itr;
+                break;
+            }
+        }
+    }
+    if(found != deferred.end()) deferred.erase(found);
+}
+
+static bool save_snapshot(tester& t, const std::string& path, uint64_t line){
+    FILE* out = std::fopen(path.c_str(), "wb");
+    if(!out) return false;
+    auto state = t.snapshot();
+    std::fwrite(snapshot_magic, 1, sizeof(snapshot_magic), out);
+    std::fwrite(&line, sizeof(line), 1, out);
+    std::fwrite(state.data(), 1, state.size(), out);
+    return std::fclose(out) == 0;
+}
+
+static bool load_snapshot(tester& t, const std::string& path, uint64_t& line){
+    std::ifstream in(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if(bytes.size() < sizeof(snapshot_magic) + sizeof(line) || std::memcmp(bytes.data(), snapshot_magic, sizeof(snapshot_magic))) return false;
+    std::memcpy(&line, bytes.data() + sizeof(snapshot_magic), sizeof(line));
+    t.restore(std::vector<char>(bytes.begin() + sizeof(snapshot_magic) + sizeof(line), bytes.end()));
+    return true;
+}
+
+static uint64_t digest(tester& t){
+    uint64_t h = 1469598103934665603ULL;
+    for(char c : t.snapshot()){
+        h ^= (uint8_t)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+//跳过前skip行，从当前状态继续回放；日志格式错误返回false
+static bool replay(tester& t, const std::string& path, uint64_t skip, const options& opt, replay_result& res){
+    std::ifstream in(path);
+    if(!in){
+        std::printf("cannot read %s\n", path.c_str());
+        return false;
+    }
+    auto& c = t.chain();
+    std::string s;
+    uint64_t line = 0;
+    while(std::getline(in, s)){
+        line++;
+        if(line <= skip || s.empty()) continue;
+        if(opt.stop_at && line > opt.stop_at) break;
+
+        uint32_t time = 0;
+        action act;
+        std::string error;
+        if(!parse_line(s, time, act, error)){
+            std::printf("%s:%llu: %s\n", path.c_str(), (unsigned long long)line, error.c_str());
+            return false;
+        }
+        if(time > c.now){
+            c.now = time;
+            if(opt.deferred) t.run_deferred();
+        }
+        //日志不包含账户的初始EOS余额，不足时按需发行
+        if(act.account == tester::token && act.name == N(transfer)){
+            auto tr = eosio::unpack<token_transfer>(act.data);
+            if(t.balance(tr.from) < tr.quantity.amount){
+                t.issue(tr.from, tr.quantity.amount - t.balance(tr.from));
+                res.auto_issued++;
+            }
+        }
+        if(!opt.deferred) consume_deferred(t, act);
+
+        auto begin = std::chrono::steady_clock::now();
+        auto r = t.push({act});
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        t.traces.clear();
+
+        auto& stat = res.stats[eosio::name_to_string(act.account) + "::" + eosio::name_to_string(act.name)];
+        stat.ns.push_back((uint64_t)ns);
+        res.actions++;
+        if(!r.ok){
+            stat.failed++;
+            if(res.failed++ < 10 && !opt.quiet){
+                std::printf("%s:%llu: %s failed: %s\n", path.c_str(), (unsigned long long)line,
+                            eosio::name_to_string(act.name).c_str(), r.error.c_str());
+            }
+        }
+
+        if(opt.snapshot_every && line % opt.snapshot_every == 0){
+            std::string file = opt.snapshot_dir + "/snapshot-" + std::to_string(line) + ".bin";
+            if(!save_snapshot(t, file, line)){
+                std::printf("cannot write %s\n", file.c_str());
+                return false;
+            }
+            res.snapshots.push_back(line);
+        }
+    }
+    return true;
+}
+
+static std::string duration(uint64_t ns){
+    char buf[32];
+    if(ns < 1000) std::snprintf(buf, sizeof(buf), "%lluns", (unsigned long long)ns);
+    else if(ns < 1000000) std::snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3);
+    else std::snprintf(buf, sizeof(buf), "%.2fms", ns / 1e6);
+    return buf;
+}
+
+//每种动作的次数、失败数和分位数，下面一行是按2的幂分桶的直方图
+static void report(replay_result& res){
+    std::printf("%-28s %8s %6s %10s %10s %10s %10s %10s\n", "action", "count", "failed", "mean", "p50", "p90", "p99", "max");
+    for(auto& entry : res.stats){
+        auto& ns = entry.second.ns;
+        std::sort(ns.begin(), ns.end());
+        uint64_t total = 0;
+        for(auto v : ns) total += v;
+        auto pct = [&ns](double p){ return ns[std::min(ns.size() - 1, (size_t)(p * ns.size()))]; };
+        std::printf("%-28s %8zu %6llu %10s %10s %10s %10s %10s\n", entry.first.c_str(), ns.size(),
+                    (unsigned long long)entry.second.failed, duration(total / ns.size()).c_str(),
+                    duration(pct(0.5)).c_str(), duration(pct(0.9)).c_str(), duration(pct(0.99)).c_str(), duration(ns.back()).c_str());
+
+        std::map<int, uint64_t> buckets;
+        for(auto v : ns){
+            int b = 0;
+            while((2ULL << b) <= v) b++;
+            buckets[b]++;
+        }
+        std::string line = "   ";
+        for(const auto& b : buckets) line += " >=" + duration(1ULL << b.first) + ":" + std::to_string(b.second);
+        std::printf("%s\n", line.c_str());
+    }
+    std::printf("%llu actions, %llu failed, %llu token balances issued for replay\n",
+                (unsigned long long)res.actions, (unsigned long long)res.failed, (unsigned long long)res.auto_issued);
+}
+
+int main(int argc, char** argv){
+    if(argc < 2){
+        std::printf("usage: replay LOG [--snapshot-every N] [--snapshot-dir DIR] [--resume FILE] [--stop-at LINE] [--deferred] [--verify-resume]\n");
+        return 1;
+    }
+    std::string log = argv[1];
+    std::string resume;
+    bool verify = false;
+    options opt;
+    for(int i = 2; i < argc; i++){
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if(arg == "--deferred") opt.deferred = true;
+        else if(arg == "--verify-resume") verify = true;
+        else if(arg == "--snapshot-every" && has_value) opt.snapshot_every = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--snapshot-dir" && has_value) opt.snapshot_dir = argv[++i];
+        else if(arg == "--resume" && has_value) resume = argv[++i];
+        else if(arg == "--stop-at" && has_value) opt.stop_at = std::strtoull(argv[++i], nullptr, 10);
+        else{
+            std::printf("unknown option %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    //检查快照需要至少一个快照点
+    if(verify && !opt.snapshot_every) opt.snapshot_every = 100;
+
+    tester t;
+    t.chain().implicit_accounts = true;
+    uint64_t skip = 0;
+    if(!resume.empty()){
+        if(!load_snapshot(t, resume, skip)){
+            std::printf("cannot load snapshot %s\n", resume.c_str());
+            return 1;
+        }
+        std::printf("resumed from %s at line %llu\n", resume.c_str(), (unsigned long long)skip);
+    }
+
+    replay_result res;
+    if(!replay(t, log, skip, opt, res)) return 1;
+    report(res);
+    uint64_t full = digest(t);
+    std::printf("state digest %016llx\n", (unsigned long long)full);
+
+    //从中间的快照继续回放，最终状态必须和完整回放一致
+    if(verify){
+        if(res.snapshots.empty()){
+            std::printf("log too short for --verify-resume\n");
+            return 1;
+        }
+        uint64_t line = res.snapshots[res.snapshots.size() / 2];
+        tester resumed;
+        resumed.chain().implicit_accounts = true;
+        std::string file = opt.snapshot_dir + "/snapshot-" + std::to_string(line) + ".bin";
+        uint64_t from = 0;
+        if(!load_snapshot(resumed, file, from)) return 1;
+        options rest = opt;
+        rest.snapshot_every = 0;
+        rest.quiet = true;
+        replay_result again;
+        if(!replay(resumed, log, from, rest, again)) return 1;
+        uint64_t d = digest(resumed);
+        std::printf("resumed from line %llu: state digest %016llx\n", (unsigned long long)from, (unsigned long long)d);
+        if(d != full || again.failed != 0) return 1;
+    }
+    return res.failed ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+#pragma once
+//合约表的镜像结构，字段顺序与medishares.abi一致
+#include "tester.hpp"
+
+namespace test {
+
+    struct balance_row {
+        account_name account;
+        uint32_t     join_time;
+        uint64_t     claim_snapshot;
+        int64_t      guarantee_balance;
+        int64_t      key_balance;
+        int64_t      stake_balance;
+
+        EOSLIB_SERIALIZE(balance_row, (account)(join_time)(claim_snapshot)(guarantee_balance)(key_balance)(stake_balance))
+    };
+
+    struct registry_row {
+        account_name account;
+        uint32_t     join_time;
+
+        uint128_t by_join()const { return ((uint128_t)join_time << 64) | account; }
+
+        EOSLIB_SERIALIZE(registry_row, (account)(join_time))
+    };
+
+    struct global_row {
+        uint64_t ref_rate;
+        uint64_t guarantee_rate;
+        asset    guarantee_pool;
+        asset    bonus_pool;
+        uint64_t cases_num;
+        uint64_t applied_cases;
+        uint64_t guaranteed_accounts;
+        asset    max_claim;
+
+        EOSLIB_SERIALIZE(global_row, (ref_rate)(guarantee_rate)(guarantee_pool)(bonus_pool)(cases_num)(applied_cases)(guaranteed_accounts)(max_claim))
+    };
+
+    struct claims_row {
+        uint64_t id;
+        uint64_t claim_index;
+
+        EOSLIB_SERIALIZE(claims_row, (id)(claim_index))
+    };
+
+    //旧版accounts表
+    struct legacy_vote {
+        uint64_t case_id;
+        uint8_t  agreed;
+
+        EOSLIB_SERIALIZE(legacy_vote, (case_id)(agreed))
+    };
+
+    struct legacy_account_row {
+        account_name             account;
+        uint32_t                 join_time;
+        std::vector<asset>       asset_list;
+        std::vector<legacy_vote> vote_list;
+
+        EOSLIB_SERIALIZE(legacy_account_row, (account)(join_time)(asset_list)(vote_list))
+    };
+
+    struct ladder_row {
+        uint64_t id;
+        asset    quantity;
+        asset    output;
+        int64_t  impact_bp;
+
+        EOSLIB_SERIALIZE(ladder_row, (id)(quantity)(output)(impact_bp))
+    };
+
+    struct shard_row {
+        uint64_t id;
+        int64_t  guarantee_pool;
+        int64_t  bonus_pool;
+        int64_t  guaranteed_accounts;
+
+        EOSLIB_SERIALIZE(shard_row, (id)(guarantee_pool)(bonus_pool)(guaranteed_accounts))
+    };
+
+    struct credit_row {
+        account_name owner;
+        asset        balance;
+
+        EOSLIB_SERIALIZE(credit_row, (owner)(balance))
+    };
+
+    struct delegation_row {
+        account_name owner;
+        account_name proxy;
+
+        EOSLIB_SERIALIZE(delegation_row, (owner)(proxy))
+    };
+
+    struct proxy_row {
+        account_name proxy;
+        int64_t      delegated;
+        uint64_t     delegators;
+
+        EOSLIB_SERIALIZE(proxy_row, (proxy)(delegated)(delegators))
+    };
+
+    //batchdeposit和votebatch的参数
+    struct deposit_arg {
+        account_name beneficiary;
+        asset        quantity;
+
+        EOSLIB_SERIALIZE(deposit_arg, (beneficiary)(quantity))
+    };
+
+    struct case_vote_arg {
+        uint64_t case_id;
+        uint8_t  direction;
+
+        EOSLIB_SERIALIZE(case_vote_arg, (case_id)(direction))
+    };
+
+    struct proposal_row {
+        uint64_t     case_id;
+        uint64_t     case_name;
+        account_name proposer;
+        int64_t      required_fund;
+        uint32_t     start_time;
+        int64_t      vote_yes;
+        int64_t      vote_no;
+
+        EOSLIB_SERIALIZE(proposal_row, (case_id)(case_name)(proposer)(required_fund)(start_time)(vote_yes)(vote_no))
+    };
+
+    struct ballot_row {
+        account_name voter;
+        int64_t      weight;
+        uint8_t      agreed;
+
+        friend eosio::datastream<const char*>& operator>>(eosio::datastream<const char*>& ds, ballot_row& b){
+            ds >> b.voter;
+            uint64_t vote;
+            ds >> vote;
+            b.weight = (int64_t)(vote >> 1);
+            b.agreed = vote & 1;
+            return ds;
+        }
+    };
+
+    struct keymarket_row {
+        asset    supply;
+        asset    base_balance;
+        double   base_weight;
+        asset    quote_balance;
+        double   quote_weight;
+
+        EOSLIB_SERIALIZE(keymarket_row, (supply)(base_balance)(base_weight)(quote_balance)(quote_weight))
+    };
+
+    //按序号生成合法的账户名，prefix为单个字母
+    inline account_name account_for(char prefix, uint64_t i){
+        char buf[13] = {prefix};
+        for(int k = 11; k >= 1; --k){
+            buf[k] = char('a' + i % 26);
+            i /= 26;
+        }
+        buf[12] = 0;
+        return eosio::string_to_name(buf);
+    }
+
+    //当前的claim_index
+    inline uint64_t claim_index(tester& t){
+        claims_row c;
+        return t.get_row(N(claims), tester::code, 0, c) ? c.claim_index : 0;
+    }
+
+    //直接写入count个担保会员，同时更新global、keymarket和合约的EOS余额，保持audit的各项不变量
+    //每个会员的担保金为guarantee，奖金部分bonus换成keys个KEY，其中stake个已质押
+    inline void seed_members(tester& t, char prefix, uint64_t count, int64_t guarantee, int64_t bonus, int64_t keys, int64_t stake){
+        for(uint64_t i = 0; i < count; i++){
+            account_name a = account_for(prefix, i);
+            t.create_account(a);
+            t.set_row(N(balances), a, a, balance_row{a, t.now(), claim_index(t), guarantee, keys - stake, stake});
+            registry_row reg{a, t.now()};
+            t.set_row(N(registry), tester::code, a, reg, {reg.by_join()});
+        }
+
+        global_row gl;
+        REQUIRE(t.get_row(N(global), tester::code, 0, gl));
+        gl.guarantee_pool.amount += guarantee * (int64_t)count;
+        gl.bonus_pool.amount += bonus * (int64_t)count;
+        gl.guaranteed_accounts += count;
+        t.set_row(N(global), tester::code, 0, gl);
+
+        keymarket_row km;
+        REQUIRE(t.get_row(N(keymarket), tester::code, S(0,KEY), km));
+        km.supply.amount += keys * (int64_t)count;
+        km.base_balance.amount -= keys * (int64_t)count;
+        km.quote_balance.amount += bonus * (int64_t)count;
+        t.set_row(N(keymarket), tester::code, S(0,KEY), km);
+
+        t.issue(tester::code, (guarantee + bonus) * (int64_t)count);
+    }
+
+    inline balance_row get_balance(tester& t, account_name owner){
+        balance_row row{owner, 0, 0, 0, 0, 0};
+        t.get_row(N(balances), owner, owner, row);
+        return row;
+    }
+
+}
@@ -0,0 +1,366 @@
+#pragma once
+//宿主机测试框架：把合约编译成本地代码，用eosiolib替身模拟链上执行
+//测试代码不包含eosio.hpp（它定义的全局time类型与<ctime>冲突），只用这里导出的接口
+#include <eosiolib/asset.hpp>
+#include <eosiolib/transaction.hpp>
+#include <eosiolib/system.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+extern "C" void apply(uint64_t receiver, uint64_t code, uint64_t action);
+
+#define REQUIRE(cond) do { \
+        if(!(cond)){ \
+            std::fprintf(stderr, "%s:%d: REQUIRE(%s) failed\n", __FILE__, __LINE__, #cond); \
+            std::exit(1); \
+        } \
+    } while(0)
+
+#define REQUIRE_OK(res) do { \
+        auto _r = (res); \
+        if(!_r.ok){ \
+            std::fprintf(stderr, "%s:%d: %s failed: %s\n", __FILE__, __LINE__, #res, _r.error.c_str()); \
+            std::exit(1); \
+        } \
+    } while(0)
+
+#define REQUIRE_ERROR(res, msg) do { \
+        auto _r = (res); \
+        if(_r.ok || _r.error.find(msg) == std::string::npos){ \
+            std::fprintf(stderr, "%s:%d: %s expected error \"%s\", got \"%s\"\n", __FILE__, __LINE__, #res, msg, _r.ok ? "ok" : _r.error.c_str()); \
+            std::exit(1); \
+        } \
+    } while(0)
+
+namespace test {
+
+    using eosio::asset;
+    using eosio::action;
+    using eosio::permission_level;
+
+    inline asset eos(int64_t amount){ return asset(amount, CORE_SYMBOL); }
+    inline asset key(int64_t amount){ return asset(amount, S(0,KEY)); }
+
+    struct token_transfer {
+        account_name from;
+        account_name to;
+        asset        quantity;
+        std::string  memo;
+
+        EOSLIB_SERIALIZE(token_transfer, (from)(to)(quantity)(memo))
+    };
+
+    struct result {
+        bool        ok = true;
+        std::string error;
+        std::string console;
+    };
+
+    struct action_trace {
+        account_name receiver;
+        account_name account;
+        action_name  name;
+        std::vector<char> data;
+    };
+
+    //动作日志的一行，与nodeos历史插件的action trace字段一致：
+    //{"time":1530000000,"account":"eosio.token","name":"transfer","authorization":[{"actor":"alice","permission":"active"}],"hex_data":"..."}
+    inline void write_action(FILE* out, uint32_t time, const action& a){
+        static const char* hex = "0123456789abcdef";
+        std::string line = "{\"time\":" + std::to_string(time) +
+                           ",\"account\":\"" + eosio::name_to_string(a.account) +
+                           "\",\"name\":\"" + eosio::name_to_string(a.name) + "\",\"authorization\":[";
+        for(size_t i = 0; i < a.authorization.size(); i++){
+            if(i) line += ",";
+            line += "{\"actor\":\"" + eosio::name_to_string(a.authorization[i].actor) +
+                    "\",\"permission\":\"" + eosio::name_to_string(a.authorization[i].permission) + "\"}";
+        }
+        line += "],\"hex_data\":\"";
+        for(char ch : a.data){
+            line += hex[(uint8_t)ch >> 4];
+            line += hex[(uint8_t)ch & 0xf];
+        }
+        line += "\"}\n";
+        std::fputs(line.c_str(), out);
+    }
+
+    class tester {
+        public:
+            static constexpr account_name code = N(medishares);
+            static constexpr account_name token = N(eosio.token);
+
+            tester(){
+                eosio::host::state() = eosio::host::chain();
+                create_account(N(eosio));
+                create_account(token);
+                create_account(code);
+                eosio::host::state().now = 1530000000;
+            }
+
+            eosio::host::chain& chain(){ return eosio::host::state(); }
+
+            void create_account(account_name a){ chain().accounts.insert(a); }
+            void produce(uint32_t seconds){ chain().now += seconds; }
+            uint32_t now(){ return chain().now; }
+
+            //eosio.token由宿主机直接模拟，只支持CORE_SYMBOL
+            void issue(account_name to, int64_t amount){ tokens[to] += amount; }
+            int64_t balance(account_name a){ auto itr = tokens.find(a); return itr == tokens.end() ? 0 : itr->second; }
+
+            result push(const std::vector<action>& actions){
+                auto& c = chain();
+                auto saved_tokens = tokens;
+                size_t saved_traces = traces.size();
+                c.console.clear();
+                c.begin();
+                result r;
+                try{
+                    for(const auto& a : actions){
+                        //onerror由系统发给延迟交易的发送者
+                        account_name receiver = a.account;
+                        if(a.account == N(eosio) && a.name == N(onerror)) receiver = a.authorization[0].actor;
+                        exec(receiver, a);
+                    }
+                    c.commit();
+                    if(record){
+                        for(const auto& a : actions) write_action(record, c.now, a);
+                    }
+                }catch(const eosio::assertion_failure& e){
+                    r.ok = false;
+                    r.error = e.message;
+                    c.rollback();
+                    tokens = std::move(saved_tokens);
+                    traces.resize(saved_traces);
+                }
+                c.receiver = 0;
+                c.current = action();
+                c.recipients.clear();
+                c.inline_actions.clear();
+                r.console = c.console;
+                return r;
+            }
+
+            template<typename... Args>
+            result push_action(account_name actor, action_name name, Args&&... args){
+                return push({action(permission_level{actor, N(active)}, code, name, std::make_tuple(std::forward<Args>(args)...))});
+            }
+
+            result transfer(account_name from, account_name to, const asset& quantity, const std::string& memo = ""){
+                return push({action(permission_level{from, N(active)}, token, N(transfer), token_transfer{from, to, quantity, memo})});
+            }
+
+            //执行所有到期的延迟交易，失败时和nodeos一样向发送者投递onerror
+            size_t run_deferred(){
+                size_t executed = 0;
+                while(true){
+                    auto& c = chain();
+                    auto due = c.deferred.end();
+                    for(auto itr = c.deferred.begin(); itr != c.deferred.end(); ++itr){
+                        if(itr->second.execute_at > c.now) continue;
+                        if(due == c.deferred.end() || itr->second.execute_at < due->second.execute_at ||
+                           (itr->second.execute_at == due->second.execute_at && itr->second.sequence < due->second.sequence)){
+                            due = itr;
+                        }
+                    }
+                    if(due == c.deferred.end()) break;
+
+                    auto trx = due->second;
+                    c.deferred.erase(due);
+                    auto res = push(eosio::unpack<eosio::transaction>(trx.packed_trx).actions);
+                    if(!res.ok){
+                        deferred_errors.push_back(res.error);
+                        push({action(permission_level{trx.sender, N(active)}, N(eosio), N(onerror), eosio::onerror{trx.sender_id, trx.packed_trx})});
+                    }
+                    ++executed;
+                }
+                return executed;
+            }
+
+            //按ABI布局读写合约表，T为测试里的镜像结构
+            template<typename T>
+            bool get_row(table_name table, uint64_t scope, uint64_t pk, T& out){
+                auto r = chain().find_row({code, scope, table}, pk);
+                if(!r) return false;
+                out = eosio::unpack<T>(r->data);
+                return true;
+            }
+
+            template<typename T>
+            std::vector<T> get_rows(table_name table, uint64_t scope){
+                std::vector<T> out;
+                auto t = chain().find_table({code, scope, table});
+                if(t){
+                    for(const auto& r : t->rows) out.push_back(eosio::unpack<T>(r.second.data));
+                }
+                return out;
+            }
+
+            //有数据的所有scope
+            std::vector<uint64_t> scopes(table_name table){
+                std::vector<uint64_t> out;
+                for(const auto& t : chain().db){
+                    if(t.first.code == code && t.first.table == table && !t.second.rows.empty()) out.push_back(t.first.scope);
+                }
+                return out;
+            }
+
+            size_t row_count(table_name table, uint64_t scope){
+                auto t = chain().find_table({code, scope, table});
+                return t ? t->rows.size() : 0;
+            }
+
+            //直接写入一行，用于构造升级前的旧数据或大规模初始状态
+            template<typename T>
+            void set_row(table_name table, uint64_t scope, uint64_t pk, const T& obj, std::vector<uint128_t> secondary = {}){
+                auto& c = chain();
+                c.receiver = code;
+                c.current.account = code;
+                eosio::host::table_id tid{code, scope, table};
+                if(c.find_row(tid, pk)) c.erase_row(tid, pk);
+                c.emplace_row(tid, pk, eosio::host::row{eosio::pack(obj), code, std::move(secondary)});
+                c.receiver = 0;
+                c.current.account = 0;
+            }
+
+            //状态快照：数据库、账户、RAM、延迟交易、时间和EOS余额，与合约版本无关
+            std::vector<char> snapshot(){
+                auto& c = chain();
+                std::vector<char> out;
+                auto put = [&out](const auto& v){
+                    auto bytes = eosio::pack(v);
+                    out.insert(out.end(), bytes.begin(), bytes.end());
+                };
+                put(c.now);
+                put(c.deferred_sequence);
+                put(std::vector<account_name>(c.accounts.begin(), c.accounts.end()));
+                put((uint64_t)c.ram_usage.size());
+                for(const auto& r : c.ram_usage){ put(r.first); put(r.second); }
+                put((uint64_t)tokens.size());
+                for(const auto& b : tokens){ put(b.first); put(b.second); }
+                uint64_t tables = 0;
+                for(const auto& t : c.db) tables += !t.second.rows.empty();
+                put(tables);
+                for(const auto& t : c.db){
+                    if(t.second.rows.empty()) continue;
+                    put(t.first.code); put(t.first.scope); put(t.first.table);
+                    put((uint64_t)t.second.rows.size());
+                    for(const auto& r : t.second.rows){
+                        put(r.first); put(r.second.data); put(r.second.payer); put(r.second.secondary);
+                    }
+                }
+                put((uint64_t)c.deferred.size());
+                for(const auto& d : c.deferred){
+                    const auto& trx = d.second;
+                    put(trx.sender); put(trx.sender_id); put(trx.payer); put(trx.execute_at); put(trx.sequence); put(trx.packed_trx);
+                }
+                return out;
+            }
+
+            void restore(const std::vector<char>& in){
+                auto& c = chain();
+                bool implicit = c.implicit_accounts;
+                c = eosio::host::chain();
+                c.implicit_accounts = implicit;
+                tokens.clear();
+                eosio::datastream<const char*> ds(in.data(), in.size());
+                uint64_t n = 0;
+                ds >> c.now >> c.deferred_sequence;
+                std::vector<account_name> accounts;
+                ds >> accounts;
+                c.accounts.insert(accounts.begin(), accounts.end());
+                ds >> n;
+                for(uint64_t i = 0; i < n; i++){ account_name a; int64_t v; ds >> a >> v; c.ram_usage[a] = v; }
+                ds >> n;
+                for(uint64_t i = 0; i < n; i++){ account_name a; int64_t v; ds >> a >> v; tokens[a] = v; }
+                ds >> n;
+                for(uint64_t i = 0; i < n; i++){
+                    eosio::host::table_id tid;
+                    uint64_t rows = 0;
+                    ds >> tid.code >> tid.scope >> tid.table >> rows;
+                    for(uint64_t j = 0; j < rows; j++){
+                        uint64_t pk;
+                        eosio::host::row r;
+                        ds >> pk >> r.data >> r.payer >> r.secondary;
+                        c.load_row(tid, pk, std::move(r));
+                    }
+                }
+                ds >> n;
+                for(uint64_t i = 0; i < n; i++){
+                    eosio::host::deferred_transaction trx;
+                    ds >> trx.sender >> trx.sender_id >> trx.payer >> trx.execute_at >> trx.sequence >> trx.packed_trx;
+                    c.deferred[std::make_pair(trx.sender, trx.sender_id)] = std::move(trx);
+                }
+            }
+
+            //写成功执行的顶层action，格式同write_action，用于生成回放日志
+            FILE*                           record = nullptr;
+
+            std::map<account_name, int64_t> tokens;
+            std::vector<action_trace>       traces;
+            std::vector<std::string>        deferred_errors;
+
+        private:
+            void exec(account_name receiver, const action& act){
+                auto& c = chain();
+                auto saved_receiver = c.receiver;
+                auto saved_current = std::move(c.current);
+                auto saved_recipients = std::move(c.recipients);
+                auto saved_inline = std::move(c.inline_actions);
+
+                c.receiver = receiver;
+                c.current = act;
+                c.recipients.clear();
+                c.inline_actions.clear();
+
+                dispatch(receiver, act);
+                traces.push_back({receiver, act.account, act.name, act.data});
+
+                //通知在本action的所有内联action之前执行
+                for(size_t i = 0; i < c.recipients.size(); ++i){
+                    account_name r = c.recipients[i];
+                    if(r == act.account) continue;
+                    c.receiver = r;
+                    dispatch(r, act);
+                    traces.push_back({r, act.account, act.name, act.data});
+                }
+
+                auto inlines = std::move(c.inline_actions);
+                c.receiver = saved_receiver;
+                c.current = std::move(saved_current);
+                c.recipients = std::move(saved_recipients);
+                c.inline_actions = std::move(saved_inline);
+
+                for(const auto& a : inlines){
+                    for(const auto& p : a.authorization)
+                        eosio_assert(p.actor == receiver, "inline action must be authorized by the sending contract");
+                    exec(a.account, a);
+                }
+            }
+
+            void dispatch(account_name receiver, const action& act){
+                if(receiver == code){
+                    ::apply(receiver, act.account, act.name);
+                }else if(receiver == token && act.account == token && act.name == N(transfer)){
+                    token_apply(act.data_as<token_transfer>());
+                }
+            }
+
+            void token_apply(const token_transfer& t){
+                eosio_assert(t.from != t.to, "cannot transfer to self");
+                require_auth(t.from);
+                eosio_assert(is_account(t.to), "to account does not exist");
+                eosio_assert(t.quantity.is_valid(), "invalid quantity");
+                eosio_assert(t.quantity.amount > 0, "must transfer positive quantity");
+                eosio_assert(t.quantity.symbol == CORE_SYMBOL, "symbol precision mismatch");
+                eosio_assert(t.memo.size() <= 256, "memo has more than 256 bytes");
+                eosio_assert(balance(t.from) >= t.quantity.amount, "overdrawn balance");
+                tokens[t.from] -= t.quantity.amount;
+                tokens[t.to] += t.quantity.amount;
+                require_recipient(t.from);
+                require_recipient(t.to);
+            }
+    };
+
+}